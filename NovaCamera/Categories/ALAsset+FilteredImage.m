@@ -10,6 +10,21 @@
 
 @implementation ALAsset (FilteredImage)
 
+/**
+ * Core Image context shared by all renders. Creating a context is expensive (it sets up GPU state
+ * and caches compiled kernels), and a context is safe to use from multiple threads.
+ */
++ (CIContext *)filteredImageContext {
+    static CIContext *_context;
+    static dispatch_once_t once;
+    
+    dispatch_once(&once, ^{
+        _context = [CIContext contextWithOptions:nil];
+    });
+    
+    return _context;
+}
+
 - (UIImage *)defaultRepresentationFullSizeFilteredImage {
     ALAssetRepresentation *assetRepresentation = [self defaultRepresentation];
     CGImageRef fullResImage = [assetRepresentation fullResolutionImage];
@@ -22,13 +37,20 @@
         NSArray *filterArray = [CIFilter filterArrayFromSerializedXMP:xmpData
                                                      inputImageExtent:image.extent
                                                                 error:&error];
-        CIContext *context = [CIContext contextWithOptions:nil];
         if (filterArray && !error) {
+            // Chaining the filters only builds a recipe; Core Image concatenates the whole chain
+            // into a single program and renders it in one tiled pass when the CGImage is created.
             for (CIFilter *filter in filterArray) {
                 [filter setValue:image forKey:kCIInputImageKey];
                 image = [filter outputImage];
             }
-            fullResImage = [context createCGImage:image fromRect:[image extent]];
+            CGImageRef filteredImage = [[[self class] filteredImageContext] createCGImage:image fromRect:[image extent]];
+            if (filteredImage) {
+                UIImage *result = [UIImage imageWithCGImage:filteredImage scale:[assetRepresentation scale] orientation:(UIImageOrientation)[assetRepresentation orientation]];
+                CGImageRelease(filteredImage);
+                return result;
+            }
+            DDLogError(@"Unable to render adjustments for asset %@", [assetRepresentation url]);
         }
     }
     UIImage *result = [UIImage imageWithCGImage:fullResImage scale:[assetRepresentation scale] orientation:(UIImageOrientation)[assetRepresentation orientation]];
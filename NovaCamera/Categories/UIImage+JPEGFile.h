@@ -0,0 +1,20 @@
+//
+//  UIImage+JPEGFile.h
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+
+@interface UIImage (JPEGFile)
+
+/**
+ * Encode the image as JPEG directly into a file, preserving its orientation in the EXIF metadata.
+ * Unlike `UIImageJPEGRepresentation`, the encoded output is streamed to disk rather than
+ * accumulated in memory, so peak memory for large images is much lower.
+ */
+- (BOOL)writeJPEGToFile:(NSString *)path compressionQuality:(CGFloat)compressionQuality error:(NSError **)error;
+
+@end
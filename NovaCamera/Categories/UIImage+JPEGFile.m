@@ -0,0 +1,53 @@
+//
+//  UIImage+JPEGFile.m
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import "UIImage+JPEGFile.h"
+#import <ImageIO/ImageIO.h>
+#import <MobileCoreServices/MobileCoreServices.h>
+
+static int EXIFOrientationForImageOrientation(UIImageOrientation orientation) {
+    switch (orientation) {
+        case UIImageOrientationUpMirrored: return 2;
+        case UIImageOrientationDown: return 3;
+        case UIImageOrientationDownMirrored: return 4;
+        case UIImageOrientationLeftMirrored: return 5;
+        case UIImageOrientationRight: return 6;
+        case UIImageOrientationRightMirrored: return 7;
+        case UIImageOrientationLeft: return 8;
+        default: return 1;
+    }
+}
+
+@implementation UIImage (JPEGFile)
+
+- (BOOL)writeJPEGToFile:(NSString *)path compressionQuality:(CGFloat)compressionQuality error:(NSError **)error {
+    NSURL *url = [NSURL fileURLWithPath:path];
+    CGImageDestinationRef destination = CGImageDestinationCreateWithURL((__bridge CFURLRef)url, kUTTypeJPEG, 1, NULL);
+    BOOL success = NO;
+    if (destination && self.CGImage) {
+        NSDictionary *properties = @{ (__bridge NSString *)kCGImageDestinationLossyCompressionQuality: @(compressionQuality),
+                                      (__bridge NSString *)kCGImagePropertyOrientation: @(EXIFOrientationForImageOrientation(self.imageOrientation)) };
+        // The encoder pulls rows from the image's data provider and writes each chunk of
+        // compressed output to the file as it goes.
+        CGImageDestinationAddImage(destination, self.CGImage, (__bridge CFDictionaryRef)properties);
+        success = CGImageDestinationFinalize(destination);
+    }
+    if (destination) {
+        CFRelease(destination);
+    }
+    
+    if (!success) {
+        [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+        if (error) {
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:@{ NSFilePathErrorKey: path }];
+        }
+    }
+    return success;
+}
+
+@end
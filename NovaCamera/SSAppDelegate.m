@@ -20,6 +20,10 @@
 static void * SettingsServiceUseMultipleNovasChangedContext = &SettingsServiceUseMultipleNovasChangedContext;
 static void * SettingsServiceLightBoostChangedContext = &SettingsServiceLightBoostChangedContext;
 static void * SettingsServiceResetFocusOnSceneChangeContext = &SettingsServiceResetFocusOnSceneChangeContext;
+static void * SettingsServiceZeroShutterLagChangedContext = &SettingsServiceZeroShutterLagChangedContext;
+static void * SettingsServiceFlashFusionChangedContext = &SettingsServiceFlashFusionChangedContext;
+static void * SettingsServiceAutoFlashBrightnessChangedContext = &SettingsServiceAutoFlashBrightnessChangedContext;
+static void * SettingsServiceLowLightStackingChangedContext = &SettingsServiceLowLightStackingChangedContext;
 
 @implementation SSAppDelegate {
     SSSettingsService *_settingsService;
@@ -40,6 +44,10 @@ static void * SettingsServiceResetFocusOnSceneChangeContext = &SettingsServiceRe
     // Setup camera capture
     _captureSessionManager = [SSCaptureSessionManager sharedService];
     _captureSessionManager.shouldAutoFocusAndAutoExposeOnDeviceAreaChange = [_settingsService boolForKey:kSettingsServiceResetFocusOnSceneChangeKey];
+    _captureSessionManager.zeroShutterLagEnabled = [_settingsService boolForKey:kSettingsServiceZeroShutterLagKey];
+    _captureSessionManager.flashFusionEnabled = [_settingsService boolForKey:kSettingsServiceFlashFusionKey];
+    _captureSessionManager.meteringEnabled = [_settingsService boolForKey:kSettingsServiceAutoFlashBrightnessKey];
+    _captureSessionManager.lowLightStackingEnabled = [_settingsService boolForKey:kSettingsServiceLowLightStackingKey];
 
     // Setup theme
     [[SSTheme currentTheme] styleAppearanceProxies];
@@ -48,10 +56,15 @@ static void * SettingsServiceResetFocusOnSceneChangeContext = &SettingsServiceRe
     [_settingsService addObserver:self forKeyPath:kSettingsServiceMultipleNovasKey options:0 context:SettingsServiceUseMultipleNovasChangedContext];
     [_settingsService addObserver:self forKeyPath:kSettingsServiceLightBoostKey options:0 context:SettingsServiceLightBoostChangedContext];
     [_settingsService addObserver:self forKeyPath:kSettingsServiceResetFocusOnSceneChangeKey options:0 context:SettingsServiceResetFocusOnSceneChangeContext];
+    [_settingsService addObserver:self forKeyPath:kSettingsServiceZeroShutterLagKey options:0 context:SettingsServiceZeroShutterLagChangedContext];
+    [_settingsService addObserver:self forKeyPath:kSettingsServiceFlashFusionKey options:0 context:SettingsServiceFlashFusionChangedContext];
+    [_settingsService addObserver:self forKeyPath:kSettingsServiceAutoFlashBrightnessKey options:0 context:SettingsServiceAutoFlashBrightnessChangedContext];
+    [_settingsService addObserver:self forKeyPath:kSettingsServiceLowLightStackingKey options:0 context:SettingsServiceLowLightStackingChangedContext];
 
     // Setup flash service
     _flashService = [SSNovaFlashService sharedService];
     _flashService.useMultipleNovas = [_settingsService boolForKey:kSettingsServiceMultipleNovasKey];
+    _flashService.autoBrightnessEnabled = [_settingsService boolForKey:kSettingsServiceAutoFlashBrightnessKey];
 
     // Uncomment this in development to force one time question below to be asked every time.
     // [_settingsService clearKey:kSettingsServiceOneTimeAskedOptOutQuestion];   // DON'T CHECK IN WITH THIS LINE ENABLED!
@@ -162,6 +175,20 @@ static void * SettingsServiceResetFocusOnSceneChangeContext = &SettingsServiceRe
     if (context == SettingsServiceResetFocusOnSceneChangeContext) {
         _captureSessionManager.shouldAutoFocusAndAutoExposeOnDeviceAreaChange = [_settingsService boolForKey:kSettingsServiceResetFocusOnSceneChangeKey];
     }
+    if (context == SettingsServiceZeroShutterLagChangedContext) {
+        _captureSessionManager.zeroShutterLagEnabled = [_settingsService boolForKey:kSettingsServiceZeroShutterLagKey];
+    }
+    if (context == SettingsServiceFlashFusionChangedContext) {
+        _captureSessionManager.flashFusionEnabled = [_settingsService boolForKey:kSettingsServiceFlashFusionKey];
+    }
+    if (context == SettingsServiceAutoFlashBrightnessChangedContext) {
+        BOOL autoFlashBrightness = [_settingsService boolForKey:kSettingsServiceAutoFlashBrightnessKey];
+        _captureSessionManager.meteringEnabled = autoFlashBrightness;
+        _flashService.autoBrightnessEnabled = autoFlashBrightness;
+    }
+    if (context == SettingsServiceLowLightStackingChangedContext) {
+        _captureSessionManager.lowLightStackingEnabled = [_settingsService boolForKey:kSettingsServiceLowLightStackingKey];
+    }
 }
 
 @end
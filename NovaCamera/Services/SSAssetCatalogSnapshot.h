@@ -0,0 +1,93 @@
+//
+//  SSAssetCatalogSnapshot.h
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+extern NSString * const SSAssetCatalogSnapshotErrorDomain;
+
+typedef enum {
+    SSAssetCatalogSnapshotErrorTruncated = 1,
+    SSAssetCatalogSnapshotErrorBadMagic,
+    SSAssetCatalogSnapshotErrorUnsupportedVersion,
+    SSAssetCatalogSnapshotErrorCorrupt,
+} SSAssetCatalogSnapshotError;
+
+/**
+ * Compact on-disk copy of the chronological asset URL list, used to serve the
+ * library immediately at startup while the live enumeration catches up.
+ *
+ * The file is a fixed header, followed by one fixed-width record per asset
+ * (string table offset and length, timestamp, flags, perceptual hash and pixel
+ * dimensions), followed by a table of UTF-8 URL strings. The file is memory-mapped when read, and URLs are parsed
+ * only as they are asked for, so opening a snapshot costs the same for any size of
+ * library. Opening checks the header and file length; the checksum over the rest of
+ * the file is checked by -validateContents:, which should be called off the main thread.
+ */
+@interface SSAssetCatalogSnapshot : NSObject
+
+/**
+ * Number of assets in the snapshot
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ * Asset URLs in chronological order (newest first). The array parses each URL the first
+ * time it is accessed; a record that can't be parsed reads as a URL matching no asset.
+ */
+@property (nonatomic, readonly) NSArray *assetURLs;
+
+/**
+ * Open the snapshot at the given path. Returns nil and sets `error` if the file is
+ * missing, truncated or has an unrecognised header.
+ */
+- (id)initWithContentsOfFile:(NSString *)path error:(NSError **)error;
+
+/**
+ * Check the whole snapshot against its checksum and parse every URL in it. Returns NO
+ * and sets `error` if it is corrupt. Reads the entire file, so avoid calling it on the main thread.
+ */
+- (BOOL)validateContents:(NSError **)error;
+
+/**
+ * URL of the asset at the given index, or nil if its record is corrupt
+ */
+- (NSURL *)assetURLAtIndex:(NSUInteger)index;
+
+/**
+ * Capture timestamp of the asset at the given index (seconds since 1970), or 0 if unknown
+ */
+- (NSTimeInterval)timestampAtIndex:(NSUInteger)index;
+
+/**
+ * Flags recorded for the asset at the given index
+ */
+- (uint32_t)flagsAtIndex:(NSUInteger)index;
+
+/**
+ * Perceptual hash recorded for the asset at the given index, or 0 if none
+ */
+- (uint64_t)perceptualHashAtIndex:(NSUInteger)index;
+
+/**
+ * Pixel dimensions recorded for the asset at the given index, or CGSizeZero if unknown
+ */
+- (CGSize)dimensionsAtIndex:(NSUInteger)index;
+
+/**
+ * Atomically write a snapshot of the given asset URLs to `path`. `timestamps`, `flags` and
+ * `perceptualHashes` are optional arrays of NSNumbers, and `dimensions` an optional array of
+ * CGSize NSValues, parallel to `assetURLs`; missing values are written as 0.
+ */
++ (BOOL)writeAssetURLs:(NSArray *)assetURLs timestamps:(NSArray *)timestamps flags:(NSArray *)flags perceptualHashes:(NSArray *)perceptualHashes dimensions:(NSArray *)dimensions toFile:(NSString *)path error:(NSError **)error;
+
+/**
+ * Default location of the snapshot file, in the application's caches directory
+ */
++ (NSString *)defaultPath;
+
+@end
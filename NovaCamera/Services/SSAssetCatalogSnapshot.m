@@ -0,0 +1,322 @@
+//
+//  SSAssetCatalogSnapshot.m
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import "SSAssetCatalogSnapshot.h"
+
+NSString * const SSAssetCatalogSnapshotErrorDomain = @"SSAssetCatalogSnapshotErrorDomain";
+
+static NSString * const kSnapshotFileName = @"AssetCatalog.snapshot";
+
+// 'NVAC', little-endian
+static const uint32_t kSnapshotMagic = 0x4341564E;
+// Version 2 added the perceptual hash to each record, and version 3 the pixel dimensions; older
+// snapshots are discarded and rebuilt
+static const uint16_t kSnapshotVersion = 3;
+
+/**
+ * On-disk header. All fields are little-endian.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t recordCount;
+    uint32_t recordSize;
+    uint32_t stringTableSize;
+    uint32_t checksum;          // FNV-1a over everything following the header
+    uint64_t reserved;
+} SSAssetCatalogSnapshotHeader;
+
+/**
+ * On-disk record, one per asset. All fields are little-endian.
+ */
+typedef struct {
+    uint32_t urlOffset;         // Offset into the string table
+    uint32_t urlLength;         // Length in bytes of the UTF-8 URL string
+    uint64_t timestampBits;     // NSTimeInterval since 1970, as raw IEEE 754 bits
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t perceptualHash;    // 0 if not computed
+    uint32_t width;             // Pixel dimensions; 0 if unknown
+    uint32_t height;
+} SSAssetCatalogSnapshotRecord;
+
+static uint32_t SSSnapshotChecksum(const uint8_t *bytes, NSUInteger length) {
+    uint32_t hash = 2166136261u;
+    for (NSUInteger i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static NSError * SSSnapshotError(SSAssetCatalogSnapshotError code, NSString *description) {
+    return [NSError errorWithDomain:SSAssetCatalogSnapshotErrorDomain code:code userInfo:@{ NSLocalizedDescriptionKey: description }];
+}
+
+@interface SSAssetCatalogSnapshot () {
+    NSData *_data;
+    NSUInteger _recordCount;
+    uint32_t _stringTableSize;
+    uint32_t _checksum;
+    __strong NSURL **_parsedURLs;     // Filled in as URLs are asked for; guarded by @synchronized(self)
+}
+- (const SSAssetCatalogSnapshotRecord *)recordAtIndex:(NSUInteger)index;
+- (NSURL *)parseAssetURLAtIndex:(NSUInteger)index;
+@end
+
+/**
+ * Read-only array over a snapshot's URLs, parsing each one the first time it's accessed
+ */
+@interface SSAssetCatalogSnapshotURLArray : NSArray {
+    SSAssetCatalogSnapshot *_snapshot;
+}
+- (id)initWithSnapshot:(SSAssetCatalogSnapshot *)snapshot;
+@end
+
+@implementation SSAssetCatalogSnapshotURLArray
+
+- (id)initWithSnapshot:(SSAssetCatalogSnapshot *)snapshot {
+    self = [super init];
+    if (self) {
+        _snapshot = snapshot;
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+    return _snapshot.count;
+}
+
+- (id)objectAtIndex:(NSUInteger)index {
+    if (index >= _snapshot.count) {
+        [NSException raise:NSRangeException format:@"Index %lu beyond bounds [0 .. %lu]", (unsigned long)index, (unsigned long)_snapshot.count];
+    }
+    NSURL *url = [_snapshot assetURLAtIndex:index];
+    if (!url) {
+        // Arrays can't hold nil; a corrupt snapshot is discarded once validation catches it
+        static NSURL *invalidURL;
+        static dispatch_once_t once;
+        dispatch_once(&once, ^{
+            invalidURL = [NSURL URLWithString:@"assets-library://asset/invalid"];
+        });
+        url = invalidURL;
+    }
+    return url;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    // Immutable; NSArray's own copy would parse every URL
+    return self;
+}
+
+@end
+
+@implementation SSAssetCatalogSnapshot
+
+- (id)initWithContentsOfFile:(NSString *)path error:(NSError **)outError {
+    self = [super init];
+    if (self) {
+        NSError *error = nil;
+        
+        // Map rather than read, so startup doesn't pay to copy the whole catalog
+        _data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:&error];
+        if (!_data) {
+            if (outError) {
+                *outError = error;
+            }
+            return nil;
+        }
+        
+        const uint8_t *bytes = _data.bytes;
+        NSUInteger length = _data.length;
+        
+        if (length < sizeof(SSAssetCatalogSnapshotHeader)) {
+            error = SSSnapshotError(SSAssetCatalogSnapshotErrorTruncated, @"Snapshot is shorter than its header");
+        }
+        
+        SSAssetCatalogSnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        if (!error) {
+            memcpy(&header, bytes, sizeof(header));
+            if (CFSwapInt32LittleToHost(header.magic) != kSnapshotMagic) {
+                error = SSSnapshotError(SSAssetCatalogSnapshotErrorBadMagic, @"Not an asset catalog snapshot");
+            } else if (CFSwapInt16LittleToHost(header.version) != kSnapshotVersion) {
+                error = SSSnapshotError(SSAssetCatalogSnapshotErrorUnsupportedVersion, @"Unsupported snapshot version");
+            } else if (CFSwapInt16LittleToHost(header.headerSize) != sizeof(SSAssetCatalogSnapshotHeader)
+                       || CFSwapInt32LittleToHost(header.recordSize) != sizeof(SSAssetCatalogSnapshotRecord)) {
+                error = SSSnapshotError(SSAssetCatalogSnapshotErrorCorrupt, @"Unexpected header or record size");
+            }
+        }
+        
+        uint32_t stringTableSize = 0;
+        if (!error) {
+            _recordCount = CFSwapInt32LittleToHost(header.recordCount);
+            stringTableSize = CFSwapInt32LittleToHost(header.stringTableSize);
+            uint64_t expectedLength = (uint64_t)sizeof(SSAssetCatalogSnapshotHeader)
+                + (uint64_t)_recordCount * sizeof(SSAssetCatalogSnapshotRecord)
+                + stringTableSize;
+            if ((uint64_t)length < expectedLength) {
+                error = SSSnapshotError(SSAssetCatalogSnapshotErrorTruncated, @"Snapshot is truncated");
+            } else if ((uint64_t)length > expectedLength) {
+                error = SSSnapshotError(SSAssetCatalogSnapshotErrorCorrupt, @"Snapshot has trailing data");
+            }
+            _stringTableSize = stringTableSize;
+            _checksum = CFSwapInt32LittleToHost(header.checksum);
+        }
+        
+        if (error) {
+            if (outError) {
+                *outError = error;
+            }
+            return nil;
+        }
+        
+        _parsedURLs = (__strong NSURL **)calloc(MAX(_recordCount, 1), sizeof(NSURL *));
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_parsedURLs) {
+        for (NSUInteger idx = 0; idx < _recordCount; idx++) {
+            _parsedURLs[idx] = nil;
+        }
+        free(_parsedURLs);
+    }
+}
+
+- (NSUInteger)count {
+    return _recordCount;
+}
+
+- (NSArray *)assetURLs {
+    // Not kept, since the array holds on to the snapshot
+    return [[SSAssetCatalogSnapshotURLArray alloc] initWithSnapshot:self];
+}
+
+- (BOOL)validateContents:(NSError **)outError {
+    NSError *error = nil;
+    const uint8_t *bytes = _data.bytes;
+    if (SSSnapshotChecksum(bytes + sizeof(SSAssetCatalogSnapshotHeader), _data.length - sizeof(SSAssetCatalogSnapshotHeader)) != _checksum) {
+        error = SSSnapshotError(SSAssetCatalogSnapshotErrorCorrupt, @"Snapshot checksum mismatch");
+    }
+    for (NSUInteger idx = 0; !error && idx < _recordCount; idx++) {
+        if (![self assetURLAtIndex:idx]) {
+            error = SSSnapshotError(SSAssetCatalogSnapshotErrorCorrupt, @"Record contains an invalid URL");
+        }
+    }
+    if (error) {
+        if (outError) {
+            *outError = error;
+        }
+        return NO;
+    }
+    return YES;
+}
+
+- (NSURL *)assetURLAtIndex:(NSUInteger)index {
+    @synchronized(self) {
+        NSURL *url = _parsedURLs[index];
+        if (!url) {
+            url = [self parseAssetURLAtIndex:index];
+            _parsedURLs[index] = url;
+        }
+        return url;
+    }
+}
+
+- (NSTimeInterval)timestampAtIndex:(NSUInteger)index {
+    uint64_t bits = CFSwapInt64LittleToHost([self recordAtIndex:index]->timestampBits);
+    NSTimeInterval timestamp;
+    memcpy(&timestamp, &bits, sizeof(timestamp));
+    return timestamp;
+}
+
+- (uint32_t)flagsAtIndex:(NSUInteger)index {
+    return CFSwapInt32LittleToHost([self recordAtIndex:index]->flags);
+}
+
+- (uint64_t)perceptualHashAtIndex:(NSUInteger)index {
+    return CFSwapInt64LittleToHost([self recordAtIndex:index]->perceptualHash);
+}
+
+- (CGSize)dimensionsAtIndex:(NSUInteger)index {
+    const SSAssetCatalogSnapshotRecord *record = [self recordAtIndex:index];
+    return CGSizeMake(CFSwapInt32LittleToHost(record->width), CFSwapInt32LittleToHost(record->height));
+}
+
++ (BOOL)writeAssetURLs:(NSArray *)assetURLs timestamps:(NSArray *)timestamps flags:(NSArray *)flags perceptualHashes:(NSArray *)perceptualHashes dimensions:(NSArray *)dimensions toFile:(NSString *)path error:(NSError **)error {
+    NSMutableData *records = [NSMutableData dataWithCapacity:assetURLs.count * sizeof(SSAssetCatalogSnapshotRecord)];
+    NSMutableData *stringTable = [NSMutableData data];
+    
+    for (NSUInteger idx = 0; idx < assetURLs.count; idx++) {
+        NSData *urlData = [[assetURLs[idx] absoluteString] dataUsingEncoding:NSUTF8StringEncoding];
+        NSTimeInterval timestamp = idx < timestamps.count ? [timestamps[idx] doubleValue] : 0;
+        uint64_t timestampBits;
+        memcpy(&timestampBits, &timestamp, sizeof(timestampBits));
+        
+        SSAssetCatalogSnapshotRecord record;
+        memset(&record, 0, sizeof(record));
+        record.urlOffset = CFSwapInt32HostToLittle((uint32_t)stringTable.length);
+        record.urlLength = CFSwapInt32HostToLittle((uint32_t)urlData.length);
+        record.timestampBits = CFSwapInt64HostToLittle(timestampBits);
+        record.flags = CFSwapInt32HostToLittle(idx < flags.count ? [flags[idx] unsignedIntValue] : 0);
+        record.perceptualHash = CFSwapInt64HostToLittle(idx < perceptualHashes.count ? [perceptualHashes[idx] unsignedLongLongValue] : 0);
+        CGSize size = idx < dimensions.count ? [dimensions[idx] CGSizeValue] : CGSizeZero;
+        record.width = CFSwapInt32HostToLittle((uint32_t)size.width);
+        record.height = CFSwapInt32HostToLittle((uint32_t)size.height);
+        
+        [records appendBytes:&record length:sizeof(record)];
+        [stringTable appendData:urlData];
+    }
+    
+    NSMutableData *body = records;
+    [body appendData:stringTable];
+    
+    SSAssetCatalogSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CFSwapInt32HostToLittle(kSnapshotMagic);
+    header.version = CFSwapInt16HostToLittle(kSnapshotVersion);
+    header.headerSize = CFSwapInt16HostToLittle(sizeof(SSAssetCatalogSnapshotHeader));
+    header.recordCount = CFSwapInt32HostToLittle((uint32_t)assetURLs.count);
+    header.recordSize = CFSwapInt32HostToLittle(sizeof(SSAssetCatalogSnapshotRecord));
+    header.stringTableSize = CFSwapInt32HostToLittle((uint32_t)stringTable.length);
+    header.checksum = CFSwapInt32HostToLittle(SSSnapshotChecksum(body.bytes, body.length));
+    
+    NSMutableData *fileData = [NSMutableData dataWithBytes:&header length:sizeof(header)];
+    [fileData appendData:body];
+    return [fileData writeToFile:path options:NSDataWritingAtomic error:error];
+}
+
++ (NSString *)defaultPath {
+    NSString *cachesDirectory = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) firstObject];
+    return [cachesDirectory stringByAppendingPathComponent:kSnapshotFileName];
+}
+
+#pragma mark - Private methods
+
+- (NSURL *)parseAssetURLAtIndex:(NSUInteger)index {
+    const SSAssetCatalogSnapshotRecord *record = [self recordAtIndex:index];
+    uint32_t urlOffset = CFSwapInt32LittleToHost(record->urlOffset);
+    uint32_t urlLength = CFSwapInt32LittleToHost(record->urlLength);
+    if ((uint64_t)urlOffset + urlLength > _stringTableSize) {
+        return nil;
+    }
+    const char *stringTable = (const char *)_data.bytes + sizeof(SSAssetCatalogSnapshotHeader) + _recordCount * sizeof(SSAssetCatalogSnapshotRecord);
+    NSString *urlString = [[NSString alloc] initWithBytes:stringTable + urlOffset length:urlLength encoding:NSUTF8StringEncoding];
+    return urlString ? [NSURL URLWithString:urlString] : nil;
+}
+
+- (const SSAssetCatalogSnapshotRecord *)recordAtIndex:(NSUInteger)index {
+    NSParameterAssert(index < _recordCount);
+    const uint8_t *records = (const uint8_t *)_data.bytes + sizeof(SSAssetCatalogSnapshotHeader);
+    return (const SSAssetCatalogSnapshotRecord *)(records + index * sizeof(SSAssetCatalogSnapshotRecord));
+}
+
+@end
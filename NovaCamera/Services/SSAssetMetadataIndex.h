@@ -0,0 +1,127 @@
+//
+//  SSAssetMetadataIndex.h
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <AssetsLibrary/AssetsLibrary.h>
+
+@class SSAssetCatalogSnapshot;
+
+typedef enum {
+    SSAssetMetadataFlagIndexed = 1 << 0,            // Metadata has been read for this asset
+    SSAssetMetadataFlagHasAdjustments = 1 << 1,     // Edited; has AdjustmentXMP
+    SSAssetMetadataFlagNovaFlash = 1 << 2,          // Taken with a Nova flash
+    SSAssetMetadataFlagHasPerceptualHash = 1 << 3,  // Perceptual hash has been computed
+} SSAssetMetadataFlags;
+
+/**
+ * Metadata for one asset
+ */
+typedef struct {
+    NSTimeInterval timestamp;   // Capture date, seconds since 1970
+    uint32_t width;             // Pixel dimensions; 0 if unknown
+    uint32_t height;
+    uint8_t orientation;        // ALAssetOrientation
+    int8_t flashMode;           // SSFlashMode used, or SSFlashModeUnknown
+    uint32_t flags;             // SSAssetMetadataFlags
+} SSAssetMetadata;
+
+/**
+ * In-memory index of per-asset metadata, so the library can be filtered and searched
+ * without loading each asset. Values are stored column by column in flat C arrays, so
+ * queries are tight loops over contiguous memory. Safe to use from any thread.
+ */
+@interface SSAssetMetadataIndex : NSObject
+
+/**
+ * Number of assets in the index
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ * Read metadata from an asset. This parses the asset's file, so avoid calling it on the main thread.
+ */
++ (SSAssetMetadata)metadataForAsset:(ALAsset *)asset;
+
+/**
+ * Compute a 64-bit perceptual hash (difference hash) of an image. Images that look alike
+ * have hashes that differ in only a few bits, regardless of size or compression. Returns NO,
+ * leaving `hash` untouched, if `image` is NULL or can't be drawn.
+ */
++ (BOOL)getPerceptualHash:(uint64_t *)hash forImage:(CGImageRef)image;
+
+/**
+ * Number of bits that differ between two perceptual hashes
+ */
++ (NSUInteger)distanceFromPerceptualHash:(uint64_t)hash toPerceptualHash:(uint64_t)otherHash;
+
+/**
+ * Whether metadata has been recorded for the given asset
+ */
+- (BOOL)hasMetadataForAssetURL:(NSURL *)assetURL;
+
+/**
+ * Look up metadata for an asset. Returns NO if it hasn't been indexed.
+ */
+- (BOOL)getMetadata:(SSAssetMetadata *)metadata forAssetURL:(NSURL *)assetURL;
+
+/**
+ * Add or replace the metadata for an asset
+ */
+- (void)setMetadata:(SSAssetMetadata)metadata forAssetURL:(NSURL *)assetURL;
+
+/**
+ * Look up the perceptual hash for an asset. Returns NO if it hasn't been computed.
+ */
+- (BOOL)getPerceptualHash:(uint64_t *)hash forAssetURL:(NSURL *)assetURL;
+
+/**
+ * Record the perceptual hash for an asset. Ignored if the asset's metadata hasn't been set.
+ */
+- (void)setPerceptualHash:(uint64_t)hash forAssetURL:(NSURL *)assetURL;
+
+/**
+ * Remove assets that are no longer in the library
+ */
+- (void)removeAssetURLsNotInArray:(NSArray *)assetURLs;
+
+/**
+ * URLs of assets captured between the two dates, inclusive, in no particular order
+ */
+- (NSArray *)assetURLsFromDate:(NSDate *)startDate toDate:(NSDate *)endDate;
+
+/**
+ * URLs of assets with all of the given SSAssetMetadataFlags set, in no particular order
+ */
+- (NSArray *)assetURLsWithFlags:(uint32_t)flags;
+
+/**
+ * URLs of assets taken with the given SSFlashMode, in no particular order
+ */
+- (NSArray *)assetURLsWithFlashMode:(int)flashMode;
+
+/**
+ * URLs of assets whose perceptual hash is within `distance` bits of `hash`, in no particular order
+ */
+- (NSArray *)assetURLsWithPerceptualHash:(uint64_t)hash maximumDistance:(NSUInteger)distance;
+
+///-------------------------
+/// @name Catalog snapshots
+///-------------------------
+
+/**
+ * Load the timestamps, flags, perceptual hashes and dimensions recorded in a catalog snapshot
+ */
+- (void)restoreFromSnapshot:(SSAssetCatalogSnapshot *)snapshot;
+
+/**
+ * Timestamps, flags and perceptual hashes to record in a catalog snapshot, as arrays of NSNumbers
+ * parallel to `assetURLs`, and dimensions as an array of CGSize NSValues
+ */
+- (void)getSnapshotTimestamps:(NSArray **)timestamps flags:(NSArray **)flags perceptualHashes:(NSArray **)perceptualHashes dimensions:(NSArray **)dimensions forAssetURLs:(NSArray *)assetURLs;
+
+@end
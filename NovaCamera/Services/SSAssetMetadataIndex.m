@@ -0,0 +1,468 @@
+//
+//  SSAssetMetadataIndex.m
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import "SSAssetMetadataIndex.h"
+#import "SSAssetCatalogSnapshot.h"
+#import "SSNovaFlashService.h"
+#import <ImageIO/ImageIO.h>
+
+// Initial number of rows allocated for each column
+static const NSUInteger kInitialCapacity = 256;
+
+// Layout of the flags word stored in catalog snapshots
+static const uint32_t kSnapshotFlagsMask = 0xff;
+static const int kSnapshotFlashModeShift = 8;      // SSFlashMode + 1, so 0 means unknown
+static const int kSnapshotOrientationShift = 16;
+
+// Size of the grayscale thumbnail a difference hash is computed from; each row of
+// kPerceptualHashWidth pixels gives kPerceptualHashWidth - 1 bits
+static const size_t kPerceptualHashWidth = 9;
+static const size_t kPerceptualHashHeight = 8;
+
+/**
+ * Node of a BK-tree over perceptual hashes. Each child's hash is at exactly the distance from
+ * this node's hash given by its key, so a radius query can skip any subtree whose key is
+ * further than the radius from the query's own distance to this node.
+ */
+@interface SSPerceptualHashNode : NSObject
+@property (nonatomic, readonly) uint64_t hash64;
+@property (nonatomic, readonly) NSMutableIndexSet *rows;           // Rows with exactly this hash
+@property (nonatomic, readonly) NSMutableDictionary *children;     // Distance => SSPerceptualHashNode
+- (id)initWithHash:(uint64_t)hash;
+@end
+
+@implementation SSPerceptualHashNode
+
+- (id)initWithHash:(uint64_t)hash {
+    self = [super init];
+    if (self) {
+        _hash64 = hash;
+        _rows = [NSMutableIndexSet indexSet];
+        _children = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+@end
+
+@interface SSAssetMetadataIndex () {
+    // Columns, indexed by row
+    NSTimeInterval *_timestamps;
+    uint32_t *_widths;
+    uint32_t *_heights;
+    uint8_t *_orientations;
+    int8_t *_flashModes;
+    uint32_t *_flags;           // 0 for free rows
+    uint64_t *_perceptualHashes;
+    NSUInteger _rowCount;       // Rows in use or free
+    NSUInteger _capacity;
+    
+    NSMutableArray *_assetURLsByRow;        // NSNull for free rows
+    NSMutableDictionary *_rowsByAssetURL;
+    NSMutableIndexSet *_freeRows;
+    
+    SSPerceptualHashNode *_perceptualHashTree;
+}
+- (NSUInteger)rowForAssetURL:(NSURL *)assetURL;
+- (void)growColumns;
+- (void)insertPerceptualHashForRow:(NSUInteger)row;
+- (void)removePerceptualHashForRow:(NSUInteger)row;
+@end
+
+@implementation SSAssetMetadataIndex
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        _assetURLsByRow = [NSMutableArray array];
+        _rowsByAssetURL = [NSMutableDictionary dictionary];
+        _freeRows = [NSMutableIndexSet indexSet];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_timestamps);
+    free(_widths);
+    free(_heights);
+    free(_orientations);
+    free(_flashModes);
+    free(_flags);
+    free(_perceptualHashes);
+}
+
++ (SSAssetMetadata)metadataForAsset:(ALAsset *)asset {
+    SSAssetMetadata metadata;
+    memset(&metadata, 0, sizeof(metadata));
+    metadata.flashMode = SSFlashModeUnknown;
+    metadata.flags = SSAssetMetadataFlagIndexed;
+    
+    ALAssetRepresentation *representation = asset.defaultRepresentation;
+    metadata.timestamp = [[asset valueForProperty:ALAssetPropertyDate] timeIntervalSince1970];
+    metadata.width = (uint32_t)representation.dimensions.width;
+    metadata.height = (uint32_t)representation.dimensions.height;
+    metadata.orientation = (uint8_t)[[asset valueForProperty:ALAssetPropertyOrientation] intValue];
+    
+    NSDictionary *properties = representation.metadata;
+    if (properties[@"AdjustmentXMP"]) {
+        metadata.flags |= SSAssetMetadataFlagHasAdjustments;
+    }
+    NSString *userComment = properties[(__bridge NSString *)kCGImagePropertyExifDictionary][(__bridge NSString *)kCGImagePropertyExifUserComment];
+    SSFlashSettings flashSettings;
+    if ([userComment isKindOfClass:[NSString class]] && SSFlashSettingsFromUserComment(userComment, &flashSettings)) {
+        metadata.flags |= SSAssetMetadataFlagNovaFlash;
+        metadata.flashMode = (int8_t)flashSettings.flashMode;
+    }
+    return metadata;
+}
+
++ (BOOL)getPerceptualHash:(uint64_t *)hash forImage:(CGImageRef)image {
+    if (!image) {
+        return NO;
+    }
+    
+    // Let Core Graphics shrink the image to a tiny grayscale bitmap; this discards detail and
+    // colour so only the coarse structure of the picture contributes to the hash
+    uint8_t pixels[kPerceptualHashWidth * kPerceptualHashHeight];
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceGray();
+    CGContextRef context = CGBitmapContextCreate(pixels, kPerceptualHashWidth, kPerceptualHashHeight, 8, kPerceptualHashWidth, colorSpace, (CGBitmapInfo)kCGImageAlphaNone);
+    CGColorSpaceRelease(colorSpace);
+    if (!context) {
+        return NO;
+    }
+    CGContextSetInterpolationQuality(context, kCGInterpolationMedium);
+    CGContextDrawImage(context, CGRectMake(0, 0, kPerceptualHashWidth, kPerceptualHashHeight), image);
+    CGContextRelease(context);
+    
+    // One bit per horizontally adjacent pair: set if brightness increases left to right
+    uint64_t bits = 0;
+    for (size_t y = 0; y < kPerceptualHashHeight; y++) {
+        const uint8_t *row = pixels + y * kPerceptualHashWidth;
+        for (size_t x = 0; x < kPerceptualHashWidth - 1; x++) {
+            bits = (bits << 1) | (row[x] < row[x + 1] ? 1 : 0);
+        }
+    }
+    if (hash) {
+        *hash = bits;
+    }
+    return YES;
+}
+
++ (NSUInteger)distanceFromPerceptualHash:(uint64_t)hash toPerceptualHash:(uint64_t)otherHash {
+    return (NSUInteger)__builtin_popcountll(hash ^ otherHash);
+}
+
+#pragma mark - Public methods
+
+- (NSUInteger)count {
+    @synchronized(self) {
+        return _rowsByAssetURL.count;
+    }
+}
+
+- (BOOL)hasMetadataForAssetURL:(NSURL *)assetURL {
+    @synchronized(self) {
+        return [self rowForAssetURL:assetURL] != NSNotFound;
+    }
+}
+
+- (BOOL)getPerceptualHash:(uint64_t *)hash forAssetURL:(NSURL *)assetURL {
+    @synchronized(self) {
+        NSUInteger row = [self rowForAssetURL:assetURL];
+        if (row == NSNotFound || !(_flags[row] & SSAssetMetadataFlagHasPerceptualHash)) {
+            return NO;
+        }
+        if (hash) {
+            *hash = _perceptualHashes[row];
+        }
+        return YES;
+    }
+}
+
+- (void)setPerceptualHash:(uint64_t)hash forAssetURL:(NSURL *)assetURL {
+    @synchronized(self) {
+        NSUInteger row = [self rowForAssetURL:assetURL];
+        if (row == NSNotFound) {
+            return;
+        }
+        if (_flags[row] & SSAssetMetadataFlagHasPerceptualHash) {
+            if (_perceptualHashes[row] == hash) {
+                return;
+            }
+            [self removePerceptualHashForRow:row];
+        }
+        _perceptualHashes[row] = hash;
+        _flags[row] |= SSAssetMetadataFlagHasPerceptualHash;
+        [self insertPerceptualHashForRow:row];
+    }
+}
+
+- (BOOL)getMetadata:(SSAssetMetadata *)metadata forAssetURL:(NSURL *)assetURL {
+    @synchronized(self) {
+        NSUInteger row = [self rowForAssetURL:assetURL];
+        if (row == NSNotFound) {
+            return NO;
+        }
+        if (metadata) {
+            metadata->timestamp = _timestamps[row];
+            metadata->width = _widths[row];
+            metadata->height = _heights[row];
+            metadata->orientation = _orientations[row];
+            metadata->flashMode = _flashModes[row];
+            metadata->flags = _flags[row];
+        }
+        return YES;
+    }
+}
+
+- (void)setMetadata:(SSAssetMetadata)metadata forAssetURL:(NSURL *)assetURL {
+    if (!assetURL) {
+        return;
+    }
+    @synchronized(self) {
+        NSUInteger row = [self rowForAssetURL:assetURL];
+        uint32_t hashFlag = 0;
+        if (row != NSNotFound) {
+            // Keep the perceptual hash; it's set separately
+            hashFlag = _flags[row] & SSAssetMetadataFlagHasPerceptualHash;
+        } else {
+            if (_freeRows.count > 0) {
+                row = _freeRows.firstIndex;
+                [_freeRows removeIndex:row];
+                _assetURLsByRow[row] = assetURL;
+            } else {
+                if (_rowCount == _capacity) {
+                    [self growColumns];
+                }
+                row = _rowCount++;
+                [_assetURLsByRow addObject:assetURL];
+            }
+            _rowsByAssetURL[assetURL] = @(row);
+            _perceptualHashes[row] = 0;
+        }
+        _timestamps[row] = metadata.timestamp;
+        _widths[row] = metadata.width;
+        _heights[row] = metadata.height;
+        _orientations[row] = metadata.orientation;
+        _flashModes[row] = metadata.flashMode;
+        _flags[row] = (metadata.flags & ~SSAssetMetadataFlagHasPerceptualHash) | SSAssetMetadataFlagIndexed | hashFlag;
+    }
+}
+
+- (void)removeAssetURLsNotInArray:(NSArray *)assetURLs {
+    NSSet *keep = [NSSet setWithArray:assetURLs];
+    @synchronized(self) {
+        for (NSUInteger row = 0; row < _rowCount; row++) {
+            NSURL *assetURL = _assetURLsByRow[row];
+            if (_flags[row] != 0 && ![keep containsObject:assetURL]) {
+                if (_flags[row] & SSAssetMetadataFlagHasPerceptualHash) {
+                    [self removePerceptualHashForRow:row];
+                }
+                [_rowsByAssetURL removeObjectForKey:assetURL];
+                _assetURLsByRow[row] = [NSNull null];
+                _flags[row] = 0;
+                [_freeRows addIndex:row];
+            }
+        }
+    }
+}
+
+- (NSArray *)assetURLsFromDate:(NSDate *)startDate toDate:(NSDate *)endDate {
+    NSTimeInterval start = startDate ? [startDate timeIntervalSince1970] : -DBL_MAX;
+    NSTimeInterval end = endDate ? [endDate timeIntervalSince1970] : DBL_MAX;
+    NSMutableArray *result = [NSMutableArray array];
+    @synchronized(self) {
+        const NSTimeInterval *timestamps = _timestamps;
+        const uint32_t *flags = _flags;
+        for (NSUInteger row = 0; row < _rowCount; row++) {
+            if (flags[row] != 0 && timestamps[row] >= start && timestamps[row] <= end) {
+                [result addObject:_assetURLsByRow[row]];
+            }
+        }
+    }
+    return result;
+}
+
+- (NSArray *)assetURLsWithFlags:(uint32_t)requiredFlags {
+    requiredFlags |= SSAssetMetadataFlagIndexed;
+    NSMutableArray *result = [NSMutableArray array];
+    @synchronized(self) {
+        const uint32_t *flags = _flags;
+        for (NSUInteger row = 0; row < _rowCount; row++) {
+            if ((flags[row] & requiredFlags) == requiredFlags) {
+                [result addObject:_assetURLsByRow[row]];
+            }
+        }
+    }
+    return result;
+}
+
+- (NSArray *)assetURLsWithFlashMode:(int)flashMode {
+    NSMutableArray *result = [NSMutableArray array];
+    @synchronized(self) {
+        const int8_t *flashModes = _flashModes;
+        const uint32_t *flags = _flags;
+        for (NSUInteger row = 0; row < _rowCount; row++) {
+            if (flashModes[row] == flashMode && flags[row] != 0) {
+                [result addObject:_assetURLsByRow[row]];
+            }
+        }
+    }
+    return result;
+}
+
+- (NSArray *)assetURLsWithPerceptualHash:(uint64_t)hash maximumDistance:(NSUInteger)distance {
+    NSMutableArray *result = [NSMutableArray array];
+    @synchronized(self) {
+        if (!_perceptualHashTree) {
+            return result;
+        }
+        NSMutableArray *pending = [NSMutableArray arrayWithObject:_perceptualHashTree];
+        while (pending.count > 0) {
+            SSPerceptualHashNode *node = [pending lastObject];
+            [pending removeLastObject];
+            
+            NSUInteger nodeDistance = [[self class] distanceFromPerceptualHash:hash toPerceptualHash:node.hash64];
+            if (nodeDistance <= distance) {
+                [node.rows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+                    [result addObject:_assetURLsByRow[row]];
+                }];
+            }
+            
+            // By the triangle inequality, matches can only be in children whose distance
+            // from this node is within `distance` of the query's distance from it
+            NSUInteger minChildDistance = nodeDistance > distance ? nodeDistance - distance : 0;
+            NSUInteger maxChildDistance = nodeDistance + distance;
+            [node.children enumerateKeysAndObjectsUsingBlock:^(NSNumber *key, SSPerceptualHashNode *child, BOOL *stop) {
+                NSUInteger childDistance = [key unsignedIntegerValue];
+                if (childDistance >= minChildDistance && childDistance <= maxChildDistance) {
+                    [pending addObject:child];
+                }
+            }];
+        }
+    }
+    return result;
+}
+
+- (void)restoreFromSnapshot:(SSAssetCatalogSnapshot *)snapshot {
+    for (NSUInteger idx = 0; idx < snapshot.count; idx++) {
+        NSURL *assetURL = [snapshot assetURLAtIndex:idx];
+        uint32_t packedFlags = [snapshot flagsAtIndex:idx];
+        if (!(packedFlags & SSAssetMetadataFlagIndexed)) {
+            // Not indexed when the snapshot was taken
+            continue;
+        }
+        SSAssetMetadata metadata;
+        memset(&metadata, 0, sizeof(metadata));
+        metadata.timestamp = [snapshot timestampAtIndex:idx];
+        CGSize size = [snapshot dimensionsAtIndex:idx];
+        metadata.width = (uint32_t)size.width;
+        metadata.height = (uint32_t)size.height;
+        metadata.flags = packedFlags & kSnapshotFlagsMask;
+        metadata.flashMode = (int8_t)((int)((packedFlags >> kSnapshotFlashModeShift) & 0xff) - 1);
+        metadata.orientation = (uint8_t)((packedFlags >> kSnapshotOrientationShift) & 0xff);
+        [self setMetadata:metadata forAssetURL:assetURL];
+        if (packedFlags & SSAssetMetadataFlagHasPerceptualHash) {
+            [self setPerceptualHash:[snapshot perceptualHashAtIndex:idx] forAssetURL:assetURL];
+        }
+    }
+}
+
+- (void)getSnapshotTimestamps:(NSArray **)timestamps flags:(NSArray **)flags perceptualHashes:(NSArray **)perceptualHashes dimensions:(NSArray **)dimensions forAssetURLs:(NSArray *)assetURLs {
+    NSMutableArray *mutableTimestamps = [NSMutableArray arrayWithCapacity:assetURLs.count];
+    NSMutableArray *mutableDimensions = [NSMutableArray arrayWithCapacity:assetURLs.count];
+    NSMutableArray *mutableFlags = [NSMutableArray arrayWithCapacity:assetURLs.count];
+    NSMutableArray *mutableHashes = [NSMutableArray arrayWithCapacity:assetURLs.count];
+    @synchronized(self) {
+        for (NSURL *assetURL in assetURLs) {
+            NSUInteger row = [self rowForAssetURL:assetURL];
+            if (row == NSNotFound) {
+                [mutableTimestamps addObject:@0];
+                [mutableFlags addObject:@0];
+                [mutableHashes addObject:@0];
+                [mutableDimensions addObject:[NSValue valueWithCGSize:CGSizeZero]];
+                continue;
+            }
+            uint32_t packedFlags = (_flags[row] & kSnapshotFlagsMask)
+                | ((uint32_t)((_flashModes[row] + 1) & 0xff) << kSnapshotFlashModeShift)
+                | ((uint32_t)_orientations[row] << kSnapshotOrientationShift);
+            [mutableTimestamps addObject:@(_timestamps[row])];
+            [mutableFlags addObject:@(packedFlags)];
+            [mutableHashes addObject:@(_perceptualHashes[row])];
+            [mutableDimensions addObject:[NSValue valueWithCGSize:CGSizeMake(_widths[row], _heights[row])]];
+        }
+    }
+    *timestamps = mutableTimestamps;
+    *flags = mutableFlags;
+    *perceptualHashes = mutableHashes;
+    *dimensions = mutableDimensions;
+}
+
+#pragma mark - Private methods
+
+- (NSUInteger)rowForAssetURL:(NSURL *)assetURL {
+    // Must be called while synchronized
+    if (!assetURL) {
+        return NSNotFound;
+    }
+    NSNumber *row = _rowsByAssetURL[assetURL];
+    return row ? [row unsignedIntegerValue] : NSNotFound;
+}
+
+- (void)growColumns {
+    // Must be called while synchronized
+    NSUInteger capacity = MAX(kInitialCapacity, _capacity * 2);
+    _timestamps = realloc(_timestamps, capacity * sizeof(*_timestamps));
+    _widths = realloc(_widths, capacity * sizeof(*_widths));
+    _heights = realloc(_heights, capacity * sizeof(*_heights));
+    _orientations = realloc(_orientations, capacity * sizeof(*_orientations));
+    _flashModes = realloc(_flashModes, capacity * sizeof(*_flashModes));
+    _flags = realloc(_flags, capacity * sizeof(*_flags));
+    _perceptualHashes = realloc(_perceptualHashes, capacity * sizeof(*_perceptualHashes));
+    _capacity = capacity;
+}
+
+- (void)insertPerceptualHashForRow:(NSUInteger)row {
+    // Must be called while synchronized
+    uint64_t hash = _perceptualHashes[row];
+    if (!_perceptualHashTree) {
+        _perceptualHashTree = [[SSPerceptualHashNode alloc] initWithHash:hash];
+    }
+    SSPerceptualHashNode *node = _perceptualHashTree;
+    while (YES) {
+        NSUInteger distance = [[self class] distanceFromPerceptualHash:hash toPerceptualHash:node.hash64];
+        if (distance == 0) {
+            [node.rows addIndex:row];
+            return;
+        }
+        SSPerceptualHashNode *child = node.children[@(distance)];
+        if (!child) {
+            child = [[SSPerceptualHashNode alloc] initWithHash:hash];
+            node.children[@(distance)] = child;
+        }
+        node = child;
+    }
+}
+
+- (void)removePerceptualHashForRow:(NSUInteger)row {
+    // Must be called while synchronized
+    // Nodes are left in place even when they no longer hold any rows, since their
+    // children are keyed by distance from them
+    uint64_t hash = _perceptualHashes[row];
+    SSPerceptualHashNode *node = _perceptualHashTree;
+    while (node) {
+        NSUInteger distance = [[self class] distanceFromPerceptualHash:hash toPerceptualHash:node.hash64];
+        if (distance == 0) {
+            [node.rows removeIndex:row];
+            return;
+        }
+        node = node.children[@(distance)];
+    }
+}
+
+@end
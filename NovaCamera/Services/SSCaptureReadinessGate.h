@@ -0,0 +1,63 @@
+//
+//  SSCaptureReadinessGate.h
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Decides when the camera is ready to take a photo, driven by changes to the
+ * device's adjustingFocus, adjustingExposure and adjustingWhiteBalance flags
+ * rather than by sleeping and polling.
+ *
+ * If the camera isn't adjusting and nothing has asked it to, the gate opens
+ * straight away. Otherwise, after an adjustment has been requested the camera
+ * is given `adjustmentStartWindow` from the request to start adjusting. Once it
+ * has stopped adjusting (or if it never started), it must stay stable for
+ * `settleWindow` before the gate opens. If the camera never settles, the gate
+ * opens anyway after `timeout`.
+ */
+@interface SSCaptureReadinessGate : NSObject
+
+/**
+ * How long after an adjustment is requested to wait for the camera to start adjusting before
+ * assuming no adjustment is needed
+ */
+@property (nonatomic, assign) NSTimeInterval adjustmentStartWindow;
+
+/**
+ * How long all adjustments must remain finished before the camera is considered ready
+ */
+@property (nonatomic, assign) NSTimeInterval settleWindow;
+
+/**
+ * Maximum time to wait before giving up and declaring the camera ready
+ */
+@property (nonatomic, assign) NSTimeInterval timeout;
+
+/**
+ * Create a gate that calls its completion blocks on `queue`
+ */
+- (id)initWithQueue:(dispatch_queue_t)queue;
+
+/**
+ * Report the device's current adjustment flags. Call whenever any of them change.
+ */
+- (void)updateAdjustingFocus:(BOOL)adjustingFocus exposure:(BOOL)adjustingExposure whiteBalance:(BOOL)adjustingWhiteBalance;
+
+/**
+ * Report that something the camera may need to adjust to has just changed: the focus or
+ * exposure settings, or the light on the scene.
+ */
+- (void)noteAdjustmentRequested;
+
+/**
+ * Wait until the camera is ready. `settled` is NO if the wait timed out.
+ * Waits requested while another is in progress complete together with it.
+ */
+- (void)waitUntilReadyWithCompletion:(void (^)(BOOL settled))completion;
+
+@end
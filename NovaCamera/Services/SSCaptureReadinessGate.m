@@ -0,0 +1,152 @@
+//
+//  SSCaptureReadinessGate.m
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import "SSCaptureReadinessGate.h"
+#import <QuartzCore/QuartzCore.h>
+
+typedef enum {
+    SSCaptureReadinessIdle = 0,
+    SSCaptureReadinessWaitingForAdjustment,
+    SSCaptureReadinessAdjusting,
+    SSCaptureReadinessSettling,
+} SSCaptureReadinessState;
+
+@interface SSCaptureReadinessGate () {
+    dispatch_queue_t _completionQueue;
+    dispatch_queue_t _stateQueue;
+    SSCaptureReadinessState _state;
+    BOOL _adjusting;
+    CFTimeInterval _adjustmentRequestTime;  // When an adjustment was last requested; 0 if never
+    NSUInteger _waitGeneration;     // Identifies the current wait, so stale timers are ignored
+    NSUInteger _settleGeneration;   // Identifies the current settle period
+    NSMutableArray *_completions;
+}
+- (void)adjustingDidChange;
+- (void)openWithSettled:(BOOL)settled;
+- (void)scheduleSettleTimer;
+@end
+
+@implementation SSCaptureReadinessGate
+
+- (id)initWithQueue:(dispatch_queue_t)queue {
+    self = [super init];
+    if (self) {
+        _completionQueue = queue;
+        _stateQueue = dispatch_queue_create("capture readiness queue", DISPATCH_QUEUE_SERIAL);
+        _state = SSCaptureReadinessIdle;
+        _completions = [NSMutableArray array];
+        self.adjustmentStartWindow = 0.2;
+        self.settleWindow = 0.05;
+        self.timeout = 1.5;
+    }
+    return self;
+}
+
+- (void)updateAdjustingFocus:(BOOL)adjustingFocus exposure:(BOOL)adjustingExposure whiteBalance:(BOOL)adjustingWhiteBalance {
+    BOOL adjusting = adjustingFocus || adjustingExposure || adjustingWhiteBalance;
+    dispatch_async(_stateQueue, ^{
+        if (_adjusting != adjusting) {
+            _adjusting = adjusting;
+            [self adjustingDidChange];
+        }
+    });
+}
+
+- (void)noteAdjustmentRequested {
+    CFTimeInterval requestTime = CACurrentMediaTime();
+    dispatch_async(_stateQueue, ^{
+        _adjustmentRequestTime = requestTime;
+    });
+}
+
+- (void)waitUntilReadyWithCompletion:(void (^)(BOOL settled))completion {
+    dispatch_async(_stateQueue, ^{
+        if (completion) {
+            [_completions addObject:[completion copy]];
+        }
+        if (_state != SSCaptureReadinessIdle) {
+            return;
+        }
+        
+        NSUInteger generation = ++_waitGeneration;
+        NSTimeInterval sinceRequest = CACurrentMediaTime() - _adjustmentRequestTime;
+        BOOL adjustmentRequested = (_adjustmentRequestTime > 0 && sinceRequest < self.adjustmentStartWindow);
+        if (_adjusting) {
+            _state = SSCaptureReadinessAdjusting;
+        } else if (!adjustmentRequested) {
+            // Stable, and nothing has been changed that it would have to adjust to
+            [self openWithSettled:YES];
+            return;
+        } else {
+            // Give the camera a chance to notice it needs to adjust; if it doesn't start
+            // adjusting within the window, it's already stable.
+            _state = SSCaptureReadinessWaitingForAdjustment;
+            NSTimeInterval remainingWindow = self.adjustmentStartWindow - sinceRequest;
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(remainingWindow * NSEC_PER_SEC)), _stateQueue, ^{
+                if (generation == _waitGeneration && _state == SSCaptureReadinessWaitingForAdjustment) {
+                    [self openWithSettled:YES];
+                }
+            });
+        }
+        
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.timeout * NSEC_PER_SEC)), _stateQueue, ^{
+            if (generation == _waitGeneration && _state != SSCaptureReadinessIdle) {
+                DDLogVerbose(@"Camera adjustments did not settle within %g s", self.timeout);
+                [self openWithSettled:NO];
+            }
+        });
+    });
+}
+
+#pragma mark - Private methods
+
+- (void)adjustingDidChange {
+    // Must be called on _stateQueue
+    switch (_state) {
+        case SSCaptureReadinessIdle:
+            break;
+        case SSCaptureReadinessWaitingForAdjustment:
+        case SSCaptureReadinessSettling:
+            if (_adjusting) {
+                _state = SSCaptureReadinessAdjusting;
+            }
+            break;
+        case SSCaptureReadinessAdjusting:
+            if (!_adjusting) {
+                _state = SSCaptureReadinessSettling;
+                [self scheduleSettleTimer];
+            }
+            break;
+    }
+}
+
+- (void)scheduleSettleTimer {
+    // Must be called on _stateQueue
+    NSUInteger waitGeneration = _waitGeneration;
+    NSUInteger settleGeneration = ++_settleGeneration;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.settleWindow * NSEC_PER_SEC)), _stateQueue, ^{
+        if (waitGeneration == _waitGeneration && settleGeneration == _settleGeneration && _state == SSCaptureReadinessSettling) {
+            [self openWithSettled:YES];
+        }
+    });
+}
+
+- (void)openWithSettled:(BOOL)settled {
+    // Must be called on _stateQueue
+    _state = SSCaptureReadinessIdle;
+    _waitGeneration++;
+    NSArray *completions = [_completions copy];
+    [_completions removeAllObjects];
+    dispatch_async(_completionQueue, ^{
+        for (void (^completion)(BOOL) in completions) {
+            completion(settled);
+        }
+    });
+}
+
+@end
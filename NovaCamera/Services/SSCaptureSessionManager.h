@@ -10,6 +10,8 @@
 #import <Foundation/Foundation.h>
 #import <AVFoundation/AVFoundation.h>
 
+@class SSCapturedImage;
+
 /**
  * `SSCaptureSessionManager` provides a simple interface to `AVCaptureSession` and related functionality.
  */
@@ -21,10 +23,34 @@
 + (id)sharedService;
 
 /**
- * Flag determining whether light boost will be enabled in the dark
+ * Flag determining whether light boost will be enabled in the dark.
  */
 @property (nonatomic, assign) BOOL lightBoostEnabled;
 
+/**
+ * Keep a burst of preview frames once it's dark, so `captureImageNearTime:...` can merge them to
+ * bring the noise down. It's dark when the device reports that low light boost has engaged, so
+ * this needs `lightBoostEnabled` too.
+ */
+@property (nonatomic, assign) BOOL lowLightStackingEnabled;
+
+/**
+ * Keep the most recent preview frames, so `captureImageNearTime:...` can return the moment the
+ * shutter was pressed instead of a still taken once the camera has settled
+ */
+@property (nonatomic, assign) BOOL zeroShutterLagEnabled;
+
+/**
+ * Keep the most recent preview frames, so flash shots can be fused with the unlit scene by
+ * `fuseCapturedImage:withAmbientFrame:...`
+ */
+@property (nonatomic, assign) BOOL flashFusionEnabled;
+
+/**
+ * Meter preview frames with `SSPreviewMeter`, spot metering where exposure is locked
+ */
+@property (nonatomic, assign) BOOL meteringEnabled;
+
 /**
  * Capture session, instantiated when SSCaptureSessionManager is instantiated
  */
@@ -167,12 +193,41 @@
 /**
  * Initiate image capture.
  *
- * @param completion Block to call after an image has been captured and includes the raw image
- * data as `NSData` as well as a JPEG `UIImage`. If `error` is non-nil, an error has occurred.
+ * @param completion Block to call after an image has been captured. `capturedImage` carries the
+ * JPEG data and its metadata without decoding it. If `error` is non-nil, an error has occurred.
  *
  * @param shutter Block to call at the moment the actual image capture begins and can be used to fire a 
  * shutter animation.
  */
-- (void)captureStillImageWithCompletionHandler:(void (^)(NSData *imageData, UIImage *image, NSError *error))completion shutterHandler:(void (^)(int shutterCurtain))shutter;
+- (void)captureStillImageWithCompletionHandler:(void (^)(SSCapturedImage *capturedImage, NSError *error))completion shutterHandler:(void (^)(int shutterCurtain))shutter;
+
+/**
+ * Capture the image seen at `time` (from `CACurrentMediaTime()`). In the dark with light boost
+ * enabled, this merges the buffered preview frames from around that moment to reduce noise.
+ * Otherwise, with zero shutter lag enabled, it's the sharpest buffered frame from then. Failing
+ * both, a still image is captured as by `captureStillImageWithCompletionHandler:shutterHandler:`.
+ */
+- (void)captureImageNearTime:(CFTimeInterval)time completionHandler:(void (^)(SSCapturedImage *capturedImage, NSError *error))completion shutterHandler:(void (^)(int shutterCurtain))shutter;
+
+/**
+ * The buffered preview frame from just before `time`, to pass to
+ * `fuseCapturedImage:withAmbientFrame:...`. Only a few frames are buffered, so call this as soon as
+ * the shot is requested, with a time before the flash began lighting the scene. Returns nil if
+ * flash fusion isn't enabled or no frame was buffered then.
+ */
+- (id)ambientFrameBeforeTime:(CFTimeInterval)time;
+
+/**
+ * Capture a still image as by `captureStillImageWithCompletionHandler:shutterHandler:`, to be lit by
+ * the flash. The camera is given its chance to adjust to the light the flash has just added.
+ */
+- (void)captureFlashStillImageWithCompletionHandler:(void (^)(SSCapturedImage *capturedImage, NSError *error))completion shutterHandler:(void (^)(int shutterCurtain))shutter;
+
+/**
+ * Fuse a flash shot with `ambientFrame` on a background queue: the result has the colour of the
+ * ambient light and the detail of the flash shot. `completion` is called on the main queue with
+ * the fused image, or with `flashImage` itself if fusion fails.
+ */
+- (void)fuseCapturedImage:(SSCapturedImage *)flashImage withAmbientFrame:(id)ambientFrame completionHandler:(void (^)(SSCapturedImage *fusedImage))completion;
 
 @end
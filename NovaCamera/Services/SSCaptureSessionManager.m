@@ -8,21 +8,46 @@
 //  Largely based on Apple's AVCam sample code
 
 #import "SSCaptureSessionManager.h"
+#import "SSCaptureReadinessGate.h"
+#import "SSCapturedImage.h"
+#import "SSFrameRing.h"
+#import "SSFlashFusion.h"
+#import "SSFrameStacker.h"
+#import "SSImageJobScheduler.h"
+#import "SSPreviewMeter.h"
+#import "SSTraceService.h"
 #import <CoreMedia/CoreMedia.h>
+#import <ImageIO/ImageIO.h>
+#import <MobileCoreServices/MobileCoreServices.h>
 #import <AVFoundation/AVCaptureSession.h>
 
 
-// These constants are used to determine how long to pause before taking a photo to ensure focus/exposure/whitebalance are correct:
+// These constants are used to determine when the camera is ready to take a photo with correct focus/exposure/whitebalance:
 
-// How long to pause when photo is first requested, allowing the camera hardware to determine it needs to adjust focus/exposure/whitebalance.
+// How long to wait, once focus/exposure or the light on the scene has changed, for the camera hardware to start
+// adjusting focus/exposure/whitebalance. If it hasn't started adjusting within this window, no adjustment is needed.
+// When nothing has changed and the camera isn't adjusting, the photo is taken without waiting.
 const double kPauseToAllowCameraToDetermineItNeedsAdjustment = 0.2;
-// The checks are performed in a loop until the all succeed. Time to sleep between checks.
-const double kPauseBetweenEachAdjustmentCheck = 0.01;
 // How long to attempt the adjustments, before giving up and taking the photo anyway.
 const double kCameraAdjustmentTimeout = 1.5;
 // Once all adjustments are complete, ensure they remain stable for this time period before proceeding. Prevents jitter.
 const double kDurationCameraAdjustmentsNeedToSettle = 0.05;
 
+// Zero shutter lag: number of recent video frames kept (about a quarter of a second at 30 fps)
+static const NSUInteger kZeroShutterLagFrameCount = 8;
+// Frames this close to the requested time are candidates; the sharpest of them is used
+static const CFTimeInterval kZeroShutterLagWindow = 0.1;
+// Quality of JPEGs we encode ourselves, from buffered frames or fused images
+static const CGFloat kEncodedJPEGQuality = 0.9;
+
+// Low light stacking: number of buffered frames merged, taken from this close to the shutter press.
+// Frame rates drop in low light, so this reaches further back than zero shutter lag does.
+static const NSUInteger kLowLightStackFrameCount = 6;
+static const CFTimeInterval kLowLightStackWindow = 0.5;
+
+// Flash fusion: the ambient frame is the sharpest taken within this long before the flash
+static const CFTimeInterval kAmbientFrameWindow = 0.2;
+
 
 static void * CapturingStillImageContext = &CapturingStillImageContext;
 static void * AdjustingFocusContext = &AdjustingFocusContext;
@@ -32,10 +57,11 @@ static void * LowLightBoostEnabledContext = &LowLightBoostEnabledContext;
 static void * TorchActiveContext = &TorchActiveContext;
 static void * TorchLevelContext = &TorchLevelContext;
 
-@interface SSCaptureSessionManager () {
+@interface SSCaptureSessionManager () <AVCaptureVideoDataOutputSampleBufferDelegate> {
     BOOL _sessionHasBeenConfigured;
     AVCaptureVideoOrientation _orientation;
     BOOL _alreadyTogglingCamera;
+    volatile BOOL _lowLightBoostActive;     // Device reports low light boost engaged, i.e. it's dark
 }
 
 @property (nonatomic, strong) dispatch_queue_t sessionQueue;
@@ -44,11 +70,26 @@ static void * TorchLevelContext = &TorchLevelContext;
 @property (nonatomic, strong) AVCaptureStillImageOutput *stillImageOutput;
 @property (nonatomic, strong) id runtimeErrorObserver;
 @property (nonatomic, copy) void (^shutterHandler)(int shutterCurtain);
+@property (nonatomic, strong) SSCaptureReadinessGate *readinessGate;
+@property (nonatomic, strong) AVCaptureVideoDataOutput *videoDataOutput;
+@property (nonatomic, strong) dispatch_queue_t videoDataQueue;
+@property (nonatomic, strong) SSFrameRing *frameRing;
+@property (nonatomic, strong) CIContext *frameContext;
 
 - (BOOL)setDevice:(AVCaptureDevice *)device withError:(NSError **)error;
 - (BOOL)configureSession;
 - (void)subjectAreaDidChange:(NSNotification *)notification;
 - (void)deviceOrientationDidChange;
+- (BOOL)needsVideoData;
+- (CGPoint)framePointForDevicePoint:(CGPoint)devicePoint;
+- (void)updateVideoDataOutput;
+- (void)captureFrames:(NSArray *)frames completionHandler:(void (^)(SSCapturedImage *capturedImage, NSError *error))completion shutterHandler:(void (^)(int shutterCurtain))shutter;
+- (void)updateVideoDataOrientation;
+- (CGImageRef)createImageForFrame:(CVPixelBufferRef)frame scaleAndCropFactor:(CGFloat)scaleAndCropFactor CF_RETURNS_RETAINED;
+- (NSData *)JPEGDataForFrame:(CVPixelBufferRef)frame scaleAndCropFactor:(CGFloat)scaleAndCropFactor properties:(NSDictionary *)properties;
+- (NSDictionary *)propertiesForFrame:(CVPixelBufferRef)frame captureDate:(NSDate *)captureDate;
+- (NSData *)JPEGDataForImage:(CGImageRef)image properties:(NSDictionary *)properties;
+- (NSData *)JPEGDataByFusingImage:(SSCapturedImage *)flashImage withAmbientFrame:(CVPixelBufferRef)ambientFrame scaleAndCropFactor:(CGFloat)scaleAndCropFactor;
 
 @end
 
@@ -145,6 +186,7 @@ static void * TorchLevelContext = &TorchLevelContext;
             [self removeDeviceObservers:self.device];
 
             [self.session stopRunning];
+            [self.frameRing removeAllFrames];
         }
     });
 }
@@ -198,6 +240,7 @@ static void * TorchLevelContext = &TorchLevelContext;
                     self.device.focusPointOfInterest = devicePoint;
                     self.device.focusMode = mode;
                     success = YES;
+                    [self.readinessGate noteAdjustmentRequested];
                 }
             }
             [self.device unlockForConfiguration];
@@ -230,6 +273,7 @@ static void * TorchLevelContext = &TorchLevelContext;
                     self.device.exposureMode = mode;
                     self.device.exposurePointOfInterest = devicePoint;
                     success = YES;
+                    [self.readinessGate noteAdjustmentRequested];
                 }
             }
             [self.device unlockForConfiguration];
@@ -277,7 +321,7 @@ static void * TorchLevelContext = &TorchLevelContext;
     });
 }
 
-- (void)captureStillImageWithCompletionHandler:(void (^)(NSData *imageData, UIImage *image, NSError *error))completion shutterHandler:(void (^)(int shutterCurtain))shutter {
+- (void)captureStillImageWithCompletionHandler:(void (^)(SSCapturedImage *capturedImage, NSError *error))completion shutterHandler:(void (^)(int shutterCurtain))shutter {
     self.shutterHandler = shutter;
     dispatch_async(self.sessionQueue, ^{
         // Set up capture connection
@@ -289,75 +333,192 @@ static void * TorchLevelContext = &TorchLevelContext;
         // Focus/expose/whitebalance now
         NSError *error;
         if ([self.device lockForConfiguration:&error]) {
-            if ([self.device isFocusModeSupported:AVCaptureFocusModeContinuousAutoFocus]) {
+            BOOL modeChanged = NO;
+            if ([self.device isFocusModeSupported:AVCaptureFocusModeContinuousAutoFocus]
+                && self.device.focusMode != AVCaptureFocusModeContinuousAutoFocus) {
                 self.device.focusMode = AVCaptureFocusModeContinuousAutoFocus;
+                modeChanged = YES;
             }
-            if ([self.device isExposureModeSupported:AVCaptureExposureModeContinuousAutoExposure]) {
+            if ([self.device isExposureModeSupported:AVCaptureExposureModeContinuousAutoExposure]
+                && self.device.exposureMode != AVCaptureExposureModeContinuousAutoExposure) {
                 self.device.exposureMode = AVCaptureExposureModeContinuousAutoExposure;
+                modeChanged = YES;
             }
-            if ([self.device isWhiteBalanceModeSupported:AVCaptureWhiteBalanceModeContinuousAutoWhiteBalance]) {
+            if ([self.device isWhiteBalanceModeSupported:AVCaptureWhiteBalanceModeContinuousAutoWhiteBalance]
+                && self.device.whiteBalanceMode != AVCaptureWhiteBalanceModeContinuousAutoWhiteBalance) {
                 self.device.whiteBalanceMode = AVCaptureWhiteBalanceModeContinuousAutoWhiteBalance;
+                modeChanged = YES;
             }
             [self.device unlockForConfiguration];
+            if (modeChanged) {
+                [self.readinessGate noteAdjustmentRequested];
+            }
         }
 
-        // Pause a little, to allow the camera to determine if it needs to adjust itself.
-        // Because we're on a background thread we can block without locking up the UI.
-        [NSThread sleepForTimeInterval:kPauseToAllowCameraToDetermineItNeedsAdjustment];
-
-        // Go into a loop, checking if the camera focus/exposure/whitebalance is still adjusting.
-        // When all have stopped adjusting, keep going for a little longer to confirm they've settled.
-        // If they have settled for kDurationCameraAdjustmentsNeedToSettle seconds, we're ready to take the photo.
-        // If they never settle, this will eventually timeout.
-        int successCount = 0;
-        for (int i = 0; i < kCameraAdjustmentTimeout / kPauseBetweenEachAdjustmentCheck; i++) {
-            if (!self.device.isAdjustingFocus && !self.device.isAdjustingExposure && !self.device.isAdjustingWhiteBalance) {
-                successCount++;
-                if (successCount > kDurationCameraAdjustmentsNeedToSettle / kPauseBetweenEachAdjustmentCheck) {
-                    break;
-                }
+        // Wait for the camera to determine whether it needs to adjust itself and, if so, for the
+        // adjustments to finish and settle. The gate is driven by the device's adjusting* KVO
+        // notifications, so the session queue isn't blocked while we wait.
+        [self.readinessGate updateAdjustingFocus:self.device.isAdjustingFocus exposure:self.device.isAdjustingExposure whiteBalance:self.device.isAdjustingWhiteBalance];
+        SSTraceSpan settleSpan = [[SSTraceService sharedService] beginSpan:@"session.settle"];
+        [self.readinessGate waitUntilReadyWithCompletion:^(BOOL settled) {
+            [[SSTraceService sharedService] endSpan:settleSpan];
+            AVCaptureConnection *connection = [self.stillImageOutput connectionWithMediaType:AVMediaTypeVideo];
+            if (self.videoScaleAndCropFactor <= connection.videoMaxScaleAndCropFactor) {
+                connection.videoScaleAndCropFactor = self.videoScaleAndCropFactor;
             } else {
-                successCount = 0;
+                DDLogError(@"Unable to set videoScaleAndCropFactor %g as it is beyond the current AVCaptureConnection's maximum of %g", self.videoScaleAndCropFactor, connection.videoMaxScaleAndCropFactor);
             }
-            [NSThread sleepForTimeInterval:kPauseBetweenEachAdjustmentCheck];
-        }
-
-        AVCaptureConnection *connection = [self.stillImageOutput connectionWithMediaType:AVMediaTypeVideo];
-        if (self.videoScaleAndCropFactor <= connection.videoMaxScaleAndCropFactor) {
-            connection.videoScaleAndCropFactor = self.videoScaleAndCropFactor;
-        } else {
-            DDLogError(@"Unable to set videoScaleAndCropFactor %g as it is beyond the current AVCaptureConnection's maximum of %g", self.videoScaleAndCropFactor, connection.videoMaxScaleAndCropFactor);
-        }
         
-        // Attempt to set orientation
-        if ([connection isVideoOrientationSupported]) {
-            connection.videoOrientation = _orientation;
-        }
-
-        [self.stillImageOutput captureStillImageAsynchronouslyFromConnection:connection completionHandler:^(CMSampleBufferRef imageDataSampleBuffer, NSError *error) {
-            // Save to asset library
-            if (imageDataSampleBuffer) {
-                if (completion) {
-                    NSData *imageData = [AVCaptureStillImageOutput jpegStillImageNSDataRepresentation:imageDataSampleBuffer];
-                    UIImage *image = [[UIImage alloc] initWithData:imageData];
-                    dispatch_async(dispatch_get_main_queue(), ^{
-                        completion(imageData, image, error);
-                    });
-                }
-            } else if (error) {
-                DDLogError(@"Error capturing image: %@", error);
-                if (completion) {
-                    dispatch_async(dispatch_get_main_queue(), ^{
-                        completion(nil, nil, error);
-                    });
-                }
+            // Attempt to set orientation
+            if ([connection isVideoOrientationSupported]) {
+                connection.videoOrientation = _orientation;
             }
+
+            SSTraceSpan stillSpan = [[SSTraceService sharedService] beginSpan:@"session.still"];
+            [self.stillImageOutput captureStillImageAsynchronouslyFromConnection:connection completionHandler:^(CMSampleBufferRef imageDataSampleBuffer, NSError *error) {
+                [[SSTraceService sharedService] endSpan:stillSpan];
+                // Save to asset library
+                if (imageDataSampleBuffer) {
+                    if (completion) {
+                        SSTraceSpan jpegSpan = [[SSTraceService sharedService] beginSpan:@"session.jpeg"];
+                        NSData *imageData = [AVCaptureStillImageOutput jpegStillImageNSDataRepresentation:imageDataSampleBuffer];
+                        SSCapturedImage *capturedImage = [[SSCapturedImage alloc] initWithImageData:imageData];
+                        [[SSTraceService sharedService] endSpan:jpegSpan];
+                        dispatch_async(dispatch_get_main_queue(), ^{
+                            completion(capturedImage, error);
+                        });
+                    }
+                } else if (error) {
+                    DDLogError(@"Error capturing image: %@", error);
+                    if (completion) {
+                        dispatch_async(dispatch_get_main_queue(), ^{
+                            completion(nil, error);
+                        });
+                    }
+                }
+            }];
         }];
     });
 }
 
+- (void)captureImageNearTime:(CFTimeInterval)time completionHandler:(void (^)(SSCapturedImage *capturedImage, NSError *error))completion shutterHandler:(void (^)(int shutterCurtain))shutter {
+    NSMutableArray *frames = [NSMutableArray array];
+    if (self.lowLightStackingEnabled && _lowLightBoostActive) {
+        // Night mode: merge a burst of buffered frames to bring the noise down
+        CVPixelBufferRef buffers[kLowLightStackFrameCount];
+        NSUInteger count = [self.frameRing copyFrames:buffers maximumCount:kLowLightStackFrameCount nearTime:time window:kLowLightStackWindow];
+        for (NSUInteger idx = 0; idx < count; idx++) {
+            [frames addObject:(__bridge_transfer id)buffers[idx]];
+        }
+        if (frames.count < 2) {
+            [frames removeAllObjects];
+        }
+    }
+    if (frames.count == 0 && self.zeroShutterLagEnabled) {
+        CFTimeInterval frameTime = 0;
+        CVPixelBufferRef frame = [self.frameRing copyFrameNearTime:time window:kZeroShutterLagWindow timestamp:&frameTime];
+        if (frame) {
+            DDLogVerbose(@"Using buffered frame from %.0f ms %@ the requested time", fabs(frameTime - time) * 1000.0, frameTime < time ? @"before" : @"after");
+            [frames addObject:(__bridge_transfer id)frame];
+        }
+    }
+    if (frames.count == 0) {
+        DDLogVerbose(@"No buffered frames near %g; capturing a still image", time);
+        [self captureStillImageWithCompletionHandler:completion shutterHandler:shutter];
+        return;
+    }
+
+    [self captureFrames:frames completionHandler:completion shutterHandler:shutter];
+}
+
+- (id)ambientFrameBeforeTime:(CFTimeInterval)time {
+    if (!self.flashFusionEnabled) {
+        return nil;
+    }
+    CVPixelBufferRef frame = [self.frameRing copyFrameNearTime:(time - kAmbientFrameWindow / 2.0) window:(kAmbientFrameWindow / 2.0) timestamp:NULL];
+    return (__bridge_transfer id)frame;
+}
+
+- (void)captureFlashStillImageWithCompletionHandler:(void (^)(SSCapturedImage *capturedImage, NSError *error))completion shutterHandler:(void (^)(int shutterCurtain))shutter {
+    // The flash has just changed the light on the scene; give the camera its chance to adapt.
+    // Noted on the session queue, where the gate is made and the still's wait begins.
+    dispatch_async(self.sessionQueue, ^{
+        [self.readinessGate noteAdjustmentRequested];
+    });
+    [self captureStillImageWithCompletionHandler:completion shutterHandler:shutter];
+}
+
+- (void)fuseCapturedImage:(SSCapturedImage *)flashImage withAmbientFrame:(id)ambientFrame completionHandler:(void (^)(SSCapturedImage *fusedImage))completion {
+    CGFloat scaleAndCropFactor = self.videoScaleAndCropFactor;
+    // The decoded still and the fused copy of it
+    NSUInteger cost = [flashImage.metadata[(__bridge NSString *)kCGImagePropertyPixelWidth] unsignedIntegerValue] * [flashImage.metadata[(__bridge NSString *)kCGImagePropertyPixelHeight] unsignedIntegerValue] * 4 * 2;
+    SSTraceSpan fusionSpan = [[SSTraceService sharedService] beginSpan:@"session.fusion"];
+    [[SSImageJobScheduler sharedService] scheduleJobWithPriority:SSImageJobPriorityVisible cost:cost block:^(SSImageJob *job) {
+        NSData *imageData = ambientFrame ? [self JPEGDataByFusingImage:flashImage withAmbientFrame:(__bridge CVPixelBufferRef)ambientFrame scaleAndCropFactor:scaleAndCropFactor] : nil;
+        SSCapturedImage *fusedImage = imageData ? [[SSCapturedImage alloc] initWithImageData:imageData] : nil;
+        [[SSTraceService sharedService] endSpan:fusionSpan];
+        if (!fusedImage) {
+            DDLogError(@"Unable to fuse flash and ambient images; keeping the flash image");
+            fusedImage = flashImage;
+        }
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(fusedImage);
+            });
+        }
+    }];
+}
+
 #pragma mark - Properties
 
+- (void)setZeroShutterLagEnabled:(BOOL)zeroShutterLagEnabled {
+    [self willChangeValueForKey:@"zeroShutterLagEnabled"];
+    _zeroShutterLagEnabled = zeroShutterLagEnabled;
+    [self didChangeValueForKey:@"zeroShutterLagEnabled"];
+
+    dispatch_async(self.sessionQueue, ^{
+        if (_sessionHasBeenConfigured) {
+            [self updateVideoDataOutput];
+        }
+    });
+}
+
+- (void)setFlashFusionEnabled:(BOOL)flashFusionEnabled {
+    [self willChangeValueForKey:@"flashFusionEnabled"];
+    _flashFusionEnabled = flashFusionEnabled;
+    [self didChangeValueForKey:@"flashFusionEnabled"];
+
+    dispatch_async(self.sessionQueue, ^{
+        if (_sessionHasBeenConfigured) {
+            [self updateVideoDataOutput];
+        }
+    });
+}
+
+- (void)setMeteringEnabled:(BOOL)meteringEnabled {
+    [self willChangeValueForKey:@"meteringEnabled"];
+    _meteringEnabled = meteringEnabled;
+    [self didChangeValueForKey:@"meteringEnabled"];
+
+    dispatch_async(self.sessionQueue, ^{
+        if (_sessionHasBeenConfigured) {
+            [self updateVideoDataOutput];
+        }
+    });
+}
+
+- (void)setLowLightStackingEnabled:(BOOL)lowLightStackingEnabled {
+    [self willChangeValueForKey:@"lowLightStackingEnabled"];
+    _lowLightStackingEnabled = lowLightStackingEnabled;
+    [self didChangeValueForKey:@"lowLightStackingEnabled"];
+
+    dispatch_async(self.sessionQueue, ^{
+        if (_sessionHasBeenConfigured) {
+            [self updateVideoDataOutput];
+        }
+    });
+}
+
 - (void)setLightBoostEnabled:(BOOL)lightBoostEnabled {
     [self willChangeValueForKey:@"lightBoostEnabled"];
     _lightBoostEnabled = lightBoostEnabled;
@@ -559,6 +720,8 @@ static void * TorchLevelContext = &TorchLevelContext;
         return NO;
     }
     
+    [self updateVideoDataOutput];
+    
     _sessionHasBeenConfigured = YES;
     return YES;
 }
@@ -593,6 +756,219 @@ static void * TorchLevelContext = &TorchLevelContext;
             // face up/down... use last known orientation (no-op)
             break;
     }
+    
+    dispatch_async(self.sessionQueue, ^{
+        [self updateVideoDataOrientation];
+    });
+}
+
+- (BOOL)needsVideoData {
+    return self.zeroShutterLagEnabled || self.lowLightStackingEnabled || self.flashFusionEnabled || self.meteringEnabled;
+}
+
+- (CGPoint)framePointForDevicePoint:(CGPoint)devicePoint {
+    // Device points are in the sensor's landscape right orientation, but video data frames are
+    // rotated to match the interface
+    switch (_orientation) {
+        case AVCaptureVideoOrientationPortrait:
+            return CGPointMake(1.0 - devicePoint.y, devicePoint.x);
+        case AVCaptureVideoOrientationPortraitUpsideDown:
+            return CGPointMake(devicePoint.y, 1.0 - devicePoint.x);
+        case AVCaptureVideoOrientationLandscapeLeft:
+            return CGPointMake(1.0 - devicePoint.x, 1.0 - devicePoint.y);
+        default:
+            return devicePoint;
+    }
+}
+
+- (void)updateVideoDataOutput {
+    // Must be called on sessionQueue
+    BOOL needsVideoData = [self needsVideoData];
+    if (needsVideoData && !self.videoDataOutput) {
+        AVCaptureVideoDataOutput *videoDataOutput = [[AVCaptureVideoDataOutput alloc] init];
+        // Bi-planar YUV is the camera's native format, so frames arrive without a conversion
+        videoDataOutput.videoSettings = @{ (__bridge NSString *)kCVPixelBufferPixelFormatTypeKey: @(kCVPixelFormatType_420YpCbCr8BiPlanarFullRange) };
+        videoDataOutput.alwaysDiscardsLateVideoFrames = YES;
+        if (!self.videoDataQueue) {
+            self.videoDataQueue = dispatch_queue_create("video data queue", DISPATCH_QUEUE_SERIAL);
+        }
+        [videoDataOutput setSampleBufferDelegate:self queue:self.videoDataQueue];
+        
+        [self.session beginConfiguration];
+        if ([self.session canAddOutput:videoDataOutput]) {
+            [self.session addOutput:videoDataOutput];
+            self.videoDataOutput = videoDataOutput;
+        } else {
+            DDLogError(@"Unable to add video data output; buffered frame capture unavailable");
+        }
+        [self.session commitConfiguration];
+        [self updateVideoDataOrientation];
+    } else if (!needsVideoData && self.videoDataOutput) {
+        [self.session beginConfiguration];
+        [self.session removeOutput:self.videoDataOutput];
+        [self.session commitConfiguration];
+        [self.videoDataOutput setSampleBufferDelegate:nil queue:NULL];
+        self.videoDataOutput = nil;
+        [self.frameRing removeAllFrames];
+        [[SSPreviewMeter sharedService] reset];
+    }
+}
+
+- (void)updateVideoDataOrientation {
+    // Must be called on sessionQueue
+    // Buffered frames are stored upright, as a still image would be
+    AVCaptureConnection *connection = [self.videoDataOutput connectionWithMediaType:AVMediaTypeVideo];
+    if ([connection isVideoOrientationSupported] && connection.videoOrientation != _orientation) {
+        connection.videoOrientation = _orientation;
+    }
+}
+
+- (void)captureFrames:(NSArray *)frames completionHandler:(void (^)(SSCapturedImage *capturedImage, NSError *error))completion shutterHandler:(void (^)(int shutterCurtain))shutter {
+    // Merging needs a working buffer per frame besides the output and the encoded image
+    CVPixelBufferRef firstFrame = (__bridge CVPixelBufferRef)frames[0];
+    NSUInteger cost = CVPixelBufferGetWidth(firstFrame) * CVPixelBufferGetHeight(firstFrame) * (4 + frames.count);
+    CGFloat scaleAndCropFactor = self.videoScaleAndCropFactor;
+    NSDate *captureDate = [NSDate date];
+    SSTraceSpan span = [[SSTraceService sharedService] beginSpan:(frames.count > 1) ? @"session.stack" : @"session.zsl"];
+    [[SSImageJobScheduler sharedService] scheduleJobWithPriority:SSImageJobPriorityVisible cost:cost block:^(SSImageJob *job) {
+        NSUInteger referenceIndex = 0;
+        CVPixelBufferRef frame = [SSFrameStacker createStackedFrameFromFrames:frames referenceIndex:&referenceIndex];
+        NSData *imageData = nil;
+        if (frame) {
+            // A stacked frame is a new buffer, so take the metadata from the frame it's aligned to
+            NSDictionary *properties = [self propertiesForFrame:(__bridge CVPixelBufferRef)frames[referenceIndex] captureDate:captureDate];
+            imageData = [self JPEGDataForFrame:frame scaleAndCropFactor:scaleAndCropFactor properties:properties];
+            CVPixelBufferRelease(frame);
+        }
+        [[SSTraceService sharedService] endSpan:span];
+        if (!imageData) {
+            // The still has its own shutter, so nothing has been animated yet
+            DDLogError(@"Unable to process buffered frames; capturing a still image");
+            [self captureStillImageWithCompletionHandler:completion shutterHandler:shutter];
+            return;
+        }
+        SSCapturedImage *capturedImage = [[SSCapturedImage alloc] initWithImageData:imageData];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            // The frames were taken before the merge, so the shutter opens and closes at once
+            if (shutter) {
+                shutter(1);
+                shutter(2);
+            }
+            if (completion) {
+                completion(capturedImage, nil);
+            }
+        });
+    }];
+}
+
+- (CGImageRef)createImageForFrame:(CVPixelBufferRef)frame scaleAndCropFactor:(CGFloat)scaleAndCropFactor {
+    CIImage *image = [CIImage imageWithCVPixelBuffer:frame];
+    CGRect extent = image.extent;
+    if (scaleAndCropFactor > 1.0) {
+        // Crop to match the zoom applied to still images
+        extent = CGRectIntegral(CGRectInset(extent, extent.size.width * (1.0 - 1.0 / scaleAndCropFactor) / 2.0, extent.size.height * (1.0 - 1.0 / scaleAndCropFactor) / 2.0));
+    }
+    return [self.frameContext createCGImage:image fromRect:extent];
+}
+
+- (NSData *)JPEGDataForFrame:(CVPixelBufferRef)frame scaleAndCropFactor:(CGFloat)scaleAndCropFactor properties:(NSDictionary *)properties {
+    CGImageRef cgImage = [self createImageForFrame:frame scaleAndCropFactor:scaleAndCropFactor];
+    if (!cgImage) {
+        return nil;
+    }
+    NSData *imageData = [self JPEGDataForImage:cgImage properties:properties];
+    CGImageRelease(cgImage);
+    return imageData;
+}
+
+- (NSDictionary *)propertiesForFrame:(CVPixelBufferRef)frame captureDate:(NSDate *)captureDate {
+    // Give buffered frames the metadata a still image would have, so the library can date them.
+    // Exposure details come from the {Exif} attachment the frame was buffered with.
+    static NSDateFormatter *exifDateFormatter;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        exifDateFormatter = [[NSDateFormatter alloc] init];
+        exifDateFormatter.locale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
+        exifDateFormatter.dateFormat = @"yyyy:MM:dd HH:mm:ss";
+    });
+    NSString *dateString = [exifDateFormatter stringFromDate:captureDate];
+    
+    NSDictionary *frameExif = (__bridge NSDictionary *)CVBufferGetAttachment(frame, kCGImagePropertyExifDictionary, NULL);
+    NSMutableDictionary *exif = [NSMutableDictionary dictionaryWithDictionary:frameExif];
+    [exif removeObjectsForKeys:@[ (__bridge NSString *)kCGImagePropertyExifPixelXDimension, (__bridge NSString *)kCGImagePropertyExifPixelYDimension ]];
+    exif[(__bridge NSString *)kCGImagePropertyExifDateTimeOriginal] = dateString;
+    exif[(__bridge NSString *)kCGImagePropertyExifDateTimeDigitized] = dateString;
+    
+    UIDevice *device = [UIDevice currentDevice];
+    NSDictionary *tiff = @{ (__bridge NSString *)kCGImagePropertyTIFFMake: @"Apple",
+                            (__bridge NSString *)kCGImagePropertyTIFFModel: device.model,
+                            (__bridge NSString *)kCGImagePropertyTIFFSoftware: device.systemVersion,
+                            (__bridge NSString *)kCGImagePropertyTIFFDateTime: dateString,
+                            (__bridge NSString *)kCGImagePropertyTIFFOrientation: @1 };
+    
+    // Buffered frames are stored upright
+    return @{ (__bridge NSString *)kCGImagePropertyExifDictionary: exif,
+              (__bridge NSString *)kCGImagePropertyTIFFDictionary: tiff,
+              (__bridge NSString *)kCGImagePropertyOrientation: @1 };
+}
+
+- (NSData *)JPEGDataForImage:(CGImageRef)image properties:(NSDictionary *)properties {
+    NSMutableDictionary *destinationProperties = properties ? [properties mutableCopy] : [NSMutableDictionary dictionary];
+    destinationProperties[(__bridge NSString *)kCGImageDestinationLossyCompressionQuality] = @(kEncodedJPEGQuality);
+
+    NSMutableData *imageData = [NSMutableData data];
+    CGImageDestinationRef destination = CGImageDestinationCreateWithData((__bridge CFMutableDataRef)imageData, kUTTypeJPEG, 1, NULL);
+    BOOL success = NO;
+    if (destination) {
+        CGImageDestinationAddImage(destination, image, (__bridge CFDictionaryRef)destinationProperties);
+        success = CGImageDestinationFinalize(destination);
+        CFRelease(destination);
+    }
+    return success ? imageData : nil;
+}
+
+- (NSData *)JPEGDataByFusingImage:(SSCapturedImage *)flashImage withAmbientFrame:(CVPixelBufferRef)ambientFrame scaleAndCropFactor:(CGFloat)scaleAndCropFactor {
+    // Buffered frames are already upright, so decode the still upright too
+    NSDictionary *metadata = flashImage.metadata;
+    NSUInteger maxPixelSize = MAX([metadata[(__bridge NSString *)kCGImagePropertyPixelWidth] unsignedIntegerValue], [metadata[(__bridge NSString *)kCGImagePropertyPixelHeight] unsignedIntegerValue]);
+    CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)flashImage.imageData, NULL);
+    if (!source || maxPixelSize == 0) {
+        if (source) {
+            CFRelease(source);
+        }
+        return nil;
+    }
+    NSDictionary *options = @{ (__bridge NSString *)kCGImageSourceCreateThumbnailFromImageAlways: @YES,
+                               (__bridge NSString *)kCGImageSourceCreateThumbnailWithTransform: @YES,
+                               (__bridge NSString *)kCGImageSourceThumbnailMaxPixelSize: @(maxPixelSize) };
+    CGImageRef flashCGImage = CGImageSourceCreateThumbnailAtIndex(source, 0, (__bridge CFDictionaryRef)options);
+    CFRelease(source);
+    CGImageRef ambientCGImage = [self createImageForFrame:ambientFrame scaleAndCropFactor:scaleAndCropFactor];
+
+    CGImageRef fusedImage = [SSFlashFusion createFusedImageFromFlashImage:flashCGImage ambientImage:ambientCGImage];
+    CGImageRelease(flashCGImage);
+    CGImageRelease(ambientCGImage);
+    if (!fusedImage) {
+        return nil;
+    }
+
+    // Keep the still's metadata, but it's upright now and its dimensions may have swapped
+    NSMutableDictionary *properties = [metadata mutableCopy];
+    [properties removeObjectsForKeys:@[ (__bridge NSString *)kCGImagePropertyPixelWidth, (__bridge NSString *)kCGImagePropertyPixelHeight ]];
+    properties[(__bridge NSString *)kCGImagePropertyOrientation] = @1;
+    NSMutableDictionary *tiff = [properties[(__bridge NSString *)kCGImagePropertyTIFFDictionary] mutableCopy];
+    if (tiff) {
+        tiff[(__bridge NSString *)kCGImagePropertyTIFFOrientation] = @1;
+        properties[(__bridge NSString *)kCGImagePropertyTIFFDictionary] = tiff;
+    }
+    NSMutableDictionary *exif = [properties[(__bridge NSString *)kCGImagePropertyExifDictionary] mutableCopy];
+    if (exif) {
+        [exif removeObjectsForKeys:@[ (__bridge NSString *)kCGImagePropertyExifPixelXDimension, (__bridge NSString *)kCGImagePropertyExifPixelYDimension ]];
+        properties[(__bridge NSString *)kCGImagePropertyExifDictionary] = exif;
+    }
+    NSData *imageData = [self JPEGDataForImage:fusedImage properties:properties];
+    CGImageRelease(fusedImage);
+    return imageData;
 }
 
 - (dispatch_queue_t)sessionQueue {
@@ -602,6 +978,65 @@ static void * TorchLevelContext = &TorchLevelContext;
     return _sessionQueue;
 }
 
+- (SSFrameRing *)frameRing {
+    @synchronized(self) {
+        if (!_frameRing) {
+            // Night mode holds a burst of frames for the whole stack and merge
+            _frameRing = [[SSFrameRing alloc] initWithCapacity:kZeroShutterLagFrameCount heldFrameCount:kLowLightStackFrameCount];
+        }
+        return _frameRing;
+    }
+}
+
+- (CIContext *)frameContext {
+    @synchronized(self) {
+        if (!_frameContext) {
+            _frameContext = [CIContext contextWithOptions:nil];
+        }
+        return _frameContext;
+    }
+}
+
+- (SSCaptureReadinessGate *)readinessGate {
+    // Used from the device's KVO callbacks as well as the session queue
+    @synchronized(self) {
+        if (!_readinessGate) {
+            _readinessGate = [[SSCaptureReadinessGate alloc] initWithQueue:self.sessionQueue];
+            _readinessGate.adjustmentStartWindow = kPauseToAllowCameraToDetermineItNeedsAdjustment;
+            _readinessGate.settleWindow = kDurationCameraAdjustmentsNeedToSettle;
+            _readinessGate.timeout = kCameraAdjustmentTimeout;
+        }
+        return _readinessGate;
+    }
+}
+
+#pragma mark - AVCaptureVideoDataOutputSampleBufferDelegate
+
+- (void)captureOutput:(AVCaptureOutput *)captureOutput didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer fromConnection:(AVCaptureConnection *)connection {
+    // Convert the frame's presentation time from the session clock to CACurrentMediaTime()
+    CMTime presentationTime = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    CMClockRef masterClock = self.session.masterClock;
+    if (masterClock) {
+        presentationTime = CMSyncConvertTime(presentationTime, masterClock, CMClockGetHostTimeClock());
+    }
+    // Night mode frames are only worth buffering once it's dark
+    if (self.zeroShutterLagEnabled || self.flashFusionEnabled || (self.lowLightStackingEnabled && _lowLightBoostActive)) {
+        // Keep the frame's exposure details for the EXIF of a photo made from it
+        NSDictionary *exif = (__bridge NSDictionary *)CMGetAttachment(sampleBuffer, kCGImagePropertyExifDictionary, NULL);
+        NSDictionary *attachments = exif ? @{ (__bridge NSString *)kCGImagePropertyExifDictionary: exif } : nil;
+        [self.frameRing addPixelBuffer:CMSampleBufferGetImageBuffer(sampleBuffer) attachments:attachments timestamp:CMTimeGetSeconds(presentationTime)];
+    }
+    if (self.meteringEnabled) {
+        // Without the camera's brightness value, luma alone can't say how dark the scene is
+        NSDictionary *exif = (__bridge NSDictionary *)CMGetAttachment(sampleBuffer, kCGImagePropertyExifDictionary, NULL);
+        NSNumber *brightnessValue = exif[(__bridge NSString *)kCGImagePropertyExifBrightnessValue];
+        if (brightnessValue) {
+            CGPoint spotPoint = self.exposureLockActive ? [self framePointForDevicePoint:self.exposureLockDevicePoint] : CGPointMake(0.5, 0.5);
+            [[SSPreviewMeter sharedService] meterFrame:CMSampleBufferGetImageBuffer(sampleBuffer) spotPoint:spotPoint brightnessValue:brightnessValue.doubleValue timestamp:CMTimeGetSeconds(presentationTime)];
+        }
+    }
+}
+
 #pragma mark - KVO
 
 + (NSSet *)keyPathsForValuesAffectingSessionRunningAndDeviceAuthorized {
@@ -609,6 +1044,14 @@ static void * TorchLevelContext = &TorchLevelContext;
 }
 
 - (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context {
+    if (context == AdjustingFocusContext || context == AdjustingExposureContext || context == AdjustingWhiteBalanceContext) {
+        AVCaptureDevice *device = object;
+        [self.readinessGate updateAdjustingFocus:device.isAdjustingFocus exposure:device.isAdjustingExposure whiteBalance:device.isAdjustingWhiteBalance];
+    }
+    if (context == LowLightBoostEnabledContext) {
+        _lowLightBoostActive = [object isLowLightBoostEnabled];
+    }
+    
     dispatch_async(dispatch_get_main_queue(), ^{
 
 
@@ -0,0 +1,57 @@
+//
+//  SSCapturedImage.h
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <AssetsLibrary/AssetsLibrary.h>
+
+/**
+ * The result of a still image capture: the encoded JPEG bytes as produced by the camera, along
+ * with their metadata and orientation. Pixels are only decoded if `image` is requested.
+ */
+@interface SSCapturedImage : NSObject
+
+/**
+ * Encoded JPEG data, exactly as captured
+ */
+@property (nonatomic, readonly) NSData *imageData;
+
+/**
+ * Image properties (EXIF, TIFF, orientation, etc.) read from the JPEG headers without decoding it
+ */
+@property (nonatomic, readonly) NSDictionary *metadata;
+
+/**
+ * Orientation from the EXIF metadata
+ */
+@property (nonatomic, readonly) UIImageOrientation orientation;
+
+/**
+ * Decoded image. Decoded on first access and then retained; avoid this on the capture path.
+ */
+@property (nonatomic, readonly) UIImage *image;
+
+/**
+ * Quickly produce a preview no larger than `maxPixelSize` on its longest side, with orientation
+ * applied. Uses the embedded EXIF thumbnail if it's large enough, otherwise decodes the JPEG at a
+ * reduced scale, which is much cheaper than a full decode. May be called from any thread.
+ */
+- (UIImage *)previewImageWithMaxPixelSize:(CGFloat)maxPixelSize;
+
+/**
+ * Create a captured image from JPEG data. Returns nil if the data isn't a readable image.
+ */
+- (id)initWithImageData:(NSData *)imageData;
+
+/**
+ * Write the JPEG data to the saved photos album without re-encoding it. `metadata`, if
+ * given, is merged into the metadata already embedded in the JPEG. The merge is shallow: a
+ * dictionary such as {Exif} given here replaces the embedded one entirely.
+ */
+- (void)writeToSavedPhotosAlbumWithLibrary:(ALAssetsLibrary *)library metadata:(NSDictionary *)metadata completionBlock:(ALAssetsLibraryWriteImageCompletionBlock)completionBlock;
+
+@end
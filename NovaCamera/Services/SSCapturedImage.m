@@ -0,0 +1,107 @@
+//
+//  SSCapturedImage.m
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import "SSCapturedImage.h"
+#import <ImageIO/ImageIO.h>
+
+@interface SSCapturedImage () {
+    UIImage *_image;
+}
++ (UIImageOrientation)imageOrientationForEXIFOrientation:(NSInteger)exifOrientation;
+@end
+
+@implementation SSCapturedImage
+
+- (id)initWithImageData:(NSData *)imageData {
+    if (!imageData) {
+        return nil;
+    }
+    
+    // Reading the properties only parses the JPEG headers; no pixels are decoded
+    CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)imageData, NULL);
+    if (!source) {
+        DDLogError(@"Unable to create image source for captured image data");
+        return nil;
+    }
+    NSDictionary *metadata = CFBridgingRelease(CGImageSourceCopyPropertiesAtIndex(source, 0, NULL));
+    CFRelease(source);
+    if (!metadata) {
+        DDLogError(@"Unable to read properties of captured image data");
+        return nil;
+    }
+    
+    self = [super init];
+    if (self) {
+        _imageData = imageData;
+        _metadata = metadata;
+        _orientation = [[self class] imageOrientationForEXIFOrientation:[metadata[(__bridge NSString *)kCGImagePropertyOrientation] integerValue]];
+    }
+    return self;
+}
+
+- (UIImage *)image {
+    @synchronized(self) {
+        if (!_image) {
+            _image = [[UIImage alloc] initWithData:self.imageData];
+        }
+        return _image;
+    }
+}
+
+- (UIImage *)previewImageWithMaxPixelSize:(CGFloat)maxPixelSize {
+    CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)self.imageData, NULL);
+    if (!source) {
+        return nil;
+    }
+    
+    // Without a "create from image" option, only an embedded thumbnail is returned
+    NSDictionary *embeddedOptions = @{ (__bridge NSString *)kCGImageSourceCreateThumbnailWithTransform: @YES };
+    CGImageRef thumbnail = CGImageSourceCreateThumbnailAtIndex(source, 0, (__bridge CFDictionaryRef)embeddedOptions);
+    if (thumbnail && MAX(CGImageGetWidth(thumbnail), CGImageGetHeight(thumbnail)) < maxPixelSize) {
+        CGImageRelease(thumbnail);
+        thumbnail = NULL;
+    }
+    
+    if (!thumbnail) {
+        // ImageIO decodes JPEGs at 1/2, 1/4 or 1/8 scale when a smaller size is requested
+        NSDictionary *scaledOptions = @{ (__bridge NSString *)kCGImageSourceCreateThumbnailFromImageAlways: @YES,
+                                         (__bridge NSString *)kCGImageSourceCreateThumbnailWithTransform: @YES,
+                                         (__bridge NSString *)kCGImageSourceThumbnailMaxPixelSize: @(maxPixelSize) };
+        thumbnail = CGImageSourceCreateThumbnailAtIndex(source, 0, (__bridge CFDictionaryRef)scaledOptions);
+    }
+    CFRelease(source);
+    
+    if (!thumbnail) {
+        DDLogError(@"Unable to create preview of captured image");
+        return nil;
+    }
+    UIImage *preview = [UIImage imageWithCGImage:thumbnail];
+    CGImageRelease(thumbnail);
+    return preview;
+}
+
+- (void)writeToSavedPhotosAlbumWithLibrary:(ALAssetsLibrary *)library metadata:(NSDictionary *)metadata completionBlock:(ALAssetsLibraryWriteImageCompletionBlock)completionBlock {
+    [library writeImageDataToSavedPhotosAlbum:self.imageData metadata:metadata completionBlock:completionBlock];
+}
+
+#pragma mark - Private methods
+
++ (UIImageOrientation)imageOrientationForEXIFOrientation:(NSInteger)exifOrientation {
+    switch (exifOrientation) {
+        case 2: return UIImageOrientationUpMirrored;
+        case 3: return UIImageOrientationDown;
+        case 4: return UIImageOrientationDownMirrored;
+        case 5: return UIImageOrientationLeftMirrored;
+        case 6: return UIImageOrientationRight;
+        case 7: return UIImageOrientationRightMirrored;
+        case 8: return UIImageOrientationLeft;
+        default: return UIImageOrientationUp;
+    }
+}
+
+@end
@@ -9,15 +9,25 @@
 #import <Foundation/Foundation.h>
 #import <AssetsLibrary/AssetsLibrary.h>
 
+@class SSAssetMetadataIndex;
+
 NSString * const SSChronologicalAssetsLibraryUpdatedNotification;
 NSString * const SSChronologicalAssetsLibraryInsertedAssetIndexesKey;
 NSString * const SSChronologicalAssetsLibraryDeletedAssetIndexesKey;
+NSString * const SSChronologicalAssetsLibraryMovedAssetIndexesKey;
 
 /**
  * Abstraction layer on ALAssetesLibraryService, providing simplified access to
  * all available assets on device in chronological order. Responds to
  * ALAssetsLibrary notifications, updates its own contents, and sends its own
  * notifications containing a list of affected asset indexes.
+ *
+ * Inserted and moved indexes refer to the updated list; deleted indexes refer
+ * to the list as it was before the update.
+ *
+ * The list is saved to disk after each enumeration and restored on the next
+ * launch, so assets are available immediately; the first enumeration then
+ * reconciles the restored list with the library.
  */
 @interface SSChronologicalAssetsLibraryService : NSObject
 
@@ -36,6 +46,13 @@ NSString * const SSChronologicalAssetsLibraryDeletedAssetIndexesKey;
  */
 @property (nonatomic, readonly) BOOL enumeratingAssets;
 
+/**
+ * Metadata (capture date, dimensions, orientation, flash mode, edits) for the assets, for
+ * filtering without loading each asset. Filled in the background after each enumeration,
+ * so assets found recently may not be in it yet.
+ */
+@property (nonatomic, readonly) SSAssetMetadataIndex *metadataIndex;
+
 /**
  * Singleton accessor
  */
@@ -43,6 +60,10 @@ NSString * const SSChronologicalAssetsLibraryDeletedAssetIndexesKey;
 
 /**
  * Trigger enumeration of assets. Completion called with the total number of assets found.
+ *
+ * If no assets have been loaded yet, they are published in chunks as they are found, and an
+ * update notification is sent for each chunk. If enumeration is already in progress, the
+ * completion is called when that enumeration finishes.
  */
 - (void)enumerateAssetsWithCompletion:(void (^)(NSUInteger numberOfAssets))completion;
 
@@ -68,9 +89,17 @@ NSString * const SSChronologicalAssetsLibraryDeletedAssetIndexesKey;
 
 /**
  * Find index of specified asset URL. Returns NSNOtFound if the asset URL does not exist.
+ * Backed by a hash lookup, so it is cheap enough to call on every page turn.
  */
 - (NSUInteger)indexOfAssetWithURL:(NSURL *)assetURL;
 
+/**
+ * URLs of assets that look like the given one (burst shots, near duplicates), in library order
+ * and excluding the asset itself. Compares perceptual hashes, so assets that haven't been
+ * hashed yet are not found; a `distance` of around 10 bits groups bursts well.
+ */
+- (NSArray *)assetURLsSimilarToAssetWithURL:(NSURL *)assetURL maximumDistance:(NSUInteger)distance;
+
 ///----------------------
 /// @name Image retrieval
 ///----------------------
@@ -81,10 +110,18 @@ NSString * const SSChronologicalAssetsLibraryDeletedAssetIndexesKey;
 - (void)fullScreenImageForAsset:(ALAsset *)asset withCompletion:(void (^)(UIImage *image))completion;
 
 /**
- * Retrieve screen-sized image given an asset URL
+ * Retrieve screen-sized image given an asset URL. Recently displayed and prefetched
+ * images are served from memory.
  */
 - (void)fullScreenImageForAssetWithURL:(NSURL *)assetURL withCompletion:(void (^)(UIImage *image))completion;
 
+/**
+ * Keep the screen-sized image at the specified index in memory and start loading its
+ * neighbours, so swiping to them doesn't have to wait for a decode. Prefetches started
+ * for a previous index are dropped if they haven't been decoded yet.
+ */
+- (void)prefetchFullScreenImagesAroundIndex:(NSUInteger)index;
+
 /**
  * Retrieve full resolution image for specified asset
  */
@@ -7,11 +7,32 @@
 //
 
 #import "SSChronologicalAssetsLibraryService.h"
+#import "SSAssetCatalogSnapshot.h"
+#import "SSAssetMetadataIndex.h"
+#import "SSFullScreenImageCache.h"
+#import "SSImageJobScheduler.h"
 #import "ALAsset+FilteredImage.h"
 
 NSString * const SSChronologicalAssetsLibraryUpdatedNotification = @"SSChronologicalAssetsLibraryUpdatedNotification";
 NSString * const SSChronologicalAssetsLibraryInsertedAssetIndexesKey = @"SSChronologicalAssetsLibraryInsertedAssetIndexesKey";
 NSString * const SSChronologicalAssetsLibraryDeletedAssetIndexesKey = @"SSChronologicalAssetsLibraryDeletedAssetIndexesKey";
+NSString * const SSChronologicalAssetsLibraryMovedAssetIndexesKey = @"SSChronologicalAssetsLibraryMovedAssetIndexesKey";
+
+// Number of assets to collect before publishing them during the initial enumeration
+static const NSUInteger kAssetEnumerationChunkSize = 64;
+
+// Maximum size of decoded full screen images kept around for the photo pager
+static const NSUInteger kFullScreenImageCacheByteBudget = 24 * 1024 * 1024;
+
+// Number of pages on either side of the current page to prefetch
+static const NSInteger kFullScreenImagePrefetchDistance = 2;
+
+// Estimated memory held while decoding one full screen image: a screen's worth of 32-bit
+// pixels on the largest supported device
+static const NSUInteger kFullScreenImageDecodeCost = 1136 * 640 * 4;
+
+// Number of assets whose metadata is read at a time while building the metadata index
+static const NSUInteger kMetadataIndexBatchSize = 16;
 
 /**
  * Simple ALAsset category to add -defaultURL
@@ -27,34 +48,74 @@ NSString * const SSChronologicalAssetsLibraryDeletedAssetIndexesKey = @"SSChrono
 @end
 
 @interface SSChronologicalAssetsLibraryService ()
-@property (nonatomic, strong) NSMutableArray *assetURLs;
-@property (atomic, assign) BOOL restartAssetEnumeration;
+// The list and its lookup table are read from background queues, so they are never mutated in
+// place; new immutable copies are published together under a lock
+@property (atomic, copy) NSArray *assetURLs;
+@property (atomic, readonly) NSDictionary *assetIndexesByURL;
+@property (nonatomic, strong) NSMutableArray *enumerationCompletions;
 @property (atomic, assign) BOOL assetsHaveChanged;
 @property (atomic, strong) NSArray *assetURLsBeforeEnumeration;
+@property (nonatomic, assign) BOOL snapshotIsStale;
+@property (nonatomic, strong) SSFullScreenImageCache *fullScreenImageCache;
+@property (nonatomic, strong) NSMutableDictionary *fullScreenImageCompletionsByURL;
+@property (nonatomic, strong) NSMutableDictionary *fullScreenImageJobsByURL;
+@property (nonatomic, strong) dispatch_queue_t metadataIndexQueue;
+@property (atomic, assign) NSUInteger metadataIndexGeneration;
++ (NSMutableDictionary *)indexesByURLForAssetURLs:(NSArray *)assetURLs;
+- (void)appendAssetURLs:(NSArray *)assetURLs;
+- (void)rescanAssets;
+- (void)finishEnumeration;
+- (void)restoreSnapshot;
+- (void)updateMetadataIndex;
+- (void)indexMetadataForAssetURLs:(NSArray *)assetURLs fromIndex:(NSUInteger)start generation:(NSUInteger)generation;
+- (void)loadFullScreenImageForAssetWithURL:(NSURL *)assetURL completion:(void (^)(UIImage *image))completion;
+- (void)decodeFullScreenImageForAsset:(ALAsset *)asset assetURL:(NSURL *)assetURL job:(SSImageJob *)job;
+- (void)didReceiveMemoryWarning:(NSNotification *)notification;
+- (void)writeSnapshot;
 - (void)assetsChangedWithNotification:(NSNotification *)notification;
 - (void)checkAssetsForChanges;
++ (NSIndexSet *)movedIndexesForNewIndexes:(const NSUInteger *)newIndexes oldIndexes:(const NSUInteger *)oldIndexes count:(NSUInteger)count;
 @end
 
 @implementation SSChronologicalAssetsLibraryService
 
 @synthesize assetsLibrary=_assetsLibrary;
 @synthesize enumeratingAssets=_enumeratingAssets;
+@synthesize metadataIndex=_metadataIndex;
+@synthesize assetURLs=_assetURLs;
+@synthesize assetIndexesByURL=_assetIndexesByURL;
 
 - (id)init {
     self = [super init];
     if (self) {
         _assetsLibrary = [[ALAssetsLibrary alloc] init];
-        self.assetURLs = [NSMutableArray array];
+        self.assetURLs = @[];
+        self.enumerationCompletions = [NSMutableArray array];
         //self.fullResolutionImagesByURL = [NSMutableDictionary dictionary];
         
+        self.fullScreenImageCache = [[SSFullScreenImageCache alloc] initWithByteBudget:kFullScreenImageCacheByteBudget];
+        self.fullScreenImageCompletionsByURL = [NSMutableDictionary dictionary];
+        self.fullScreenImageJobsByURL = [NSMutableDictionary dictionary];
+        
+        _metadataIndex = [[SSAssetMetadataIndex alloc] init];
+        self.metadataIndexQueue = dispatch_queue_create("asset metadata index queue", DISPATCH_QUEUE_SERIAL);
+        self.metadataIndexGeneration = 0;
+        
+        // Serve the catalog saved by the previous launch until enumeration catches up
+        [self restoreSnapshot];
+        
         // Observe changes to assets library
         [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(assetsChangedWithNotification:) name:ALAssetsLibraryChangedNotification object:_assetsLibrary];
+        
+        // Drop cached images when memory is tight
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(didReceiveMemoryWarning:) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
     }
     return self;
 }
 
 - (void)dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self name:ALAssetsLibraryChangedNotification object:_assetsLibrary];
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
 }
 
 + (id)sharedService {
@@ -71,32 +132,47 @@ NSString * const SSChronologicalAssetsLibraryDeletedAssetIndexesKey = @"SSChrono
 #pragma mark - Public methods
 
 - (void)enumerateAssetsWithCompletion:(void (^)(NSUInteger numberOfAssets))completion {
+    if (completion) {
+        [self.enumerationCompletions addObject:[completion copy]];
+    }
+    if (_enumeratingAssets) {
+        // Completion will be called when the pass that's already running finishes
+        return;
+    }
+    
     __block typeof(self) bSelf = self;
-    __block NSMutableArray *mutableURLs = [NSMutableArray array];
-    __block typeof(completion) bCompletion = completion;
-    __block BOOL restartedEnumeration = NO;
+    NSMutableArray *mutableURLs = [NSMutableArray array];
     _enumeratingAssets = YES;
     
+    // With nothing to show yet, publish assets in chunks as they arrive so the first
+    // screenful is usable right away. Otherwise keep serving the current list until
+    // the new one is complete.
+    BOOL publishChunks = (self.assetURLs.count == 0);
+    
+    void (^publishChunk)() = ^{
+        NSRange range = NSMakeRange(bSelf.assetURLs.count, mutableURLs.count - bSelf.assetURLs.count);
+        if (range.length == 0) {
+            return;
+        }
+        [bSelf appendAssetURLs:[mutableURLs subarrayWithRange:range]];
+        NSDictionary *userInfo = @{
+                                   SSChronologicalAssetsLibraryInsertedAssetIndexesKey: [NSIndexSet indexSetWithIndexesInRange:range],
+                                   SSChronologicalAssetsLibraryDeletedAssetIndexesKey: [NSIndexSet indexSet],
+                                   SSChronologicalAssetsLibraryMovedAssetIndexesKey: [NSIndexSet indexSet],
+                                   };
+        [[NSNotificationCenter defaultCenter] postNotificationName:SSChronologicalAssetsLibraryUpdatedNotification object:bSelf userInfo:userInfo];
+    };
+    
     void (^finishedEnumerating)() = ^{
         DDLogVerbose(@"finishedEnumerating");
-        bSelf.assetURLs = mutableURLs;
-        bSelf->_enumeratingAssets = NO;
-        
-        if (bSelf.assetsHaveChanged) {
-            bSelf.assetsHaveChanged = NO;
+        if (publishChunks) {
+            publishChunk();
+        } else if (![bSelf.assetURLs isEqualToArray:mutableURLs]) {
+            bSelf.assetURLsBeforeEnumeration = bSelf.assetURLs;
+            bSelf.assetURLs = mutableURLs;
             [bSelf checkAssetsForChanges];
         }
-        
-        if (bCompletion) {
-            bCompletion(mutableURLs.count);
-        }
-    };
-    
-    void (^restartEnumeration)() = ^{
-        bSelf.restartAssetEnumeration = NO;
-        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
-            [bSelf enumerateAssetsWithCompletion:bCompletion];
-        });
+        [bSelf finishEnumeration];
     };
     
     DDLogVerbose(@"Starting enumeration");
@@ -111,23 +187,18 @@ NSString * const SSChronologicalAssetsLibraryDeletedAssetIndexesKey = @"SSChrono
                 if (result && result.defaultURL != nil) {
                     NSURL *url = result.defaultURL;
                     [mutableURLs addObject:url];
-                }
-                if (bSelf.restartAssetEnumeration) {
-                    *stop = YES;
-                    restartedEnumeration = YES;
-                    restartEnumeration();
+                    if (publishChunks && mutableURLs.count % kAssetEnumerationChunkSize == 0) {
+                        publishChunk();
+                    }
                 }
             }];
             DDLogVerbose(@"Found %lu assets in group", mutableURLs.count);
         } else {
-            if (!restartedEnumeration) {
-                finishedEnumerating();
-            }
+            finishedEnumerating();
         }
 } failureBlock:^(NSError *error) {
-        if (completion) {
-            completion(0);
-        }
+        DDLogError(@"Error enumerating assets: %@", error);
+        [bSelf finishEnumeration];
     }];
 }
 
@@ -158,62 +229,512 @@ NSString * const SSChronologicalAssetsLibraryDeletedAssetIndexesKey = @"SSChrono
 }
 
 - (NSUInteger)indexOfAssetWithURL:(NSURL *)assetURL {
-    return [self.assetURLs indexOfObject:assetURL];
+    if (!assetURL) {
+        return NSNotFound;
+    }
+    NSArray *assetURLs;
+    NSDictionary *indexesByURL;
+    @synchronized(self) {
+        assetURLs = _assetURLs;
+        indexesByURL = _assetIndexesByURL;
+    }
+    if (!indexesByURL) {
+        // Restored from the snapshot, and the lookup table is still being built
+        return [assetURLs indexOfObject:assetURL];
+    }
+    NSNumber *index = indexesByURL[assetURL];
+    return index ? [index unsignedIntegerValue] : NSNotFound;
+}
+
+- (NSArray *)assetURLsSimilarToAssetWithURL:(NSURL *)assetURL maximumDistance:(NSUInteger)distance {
+    uint64_t hash;
+    if (![self.metadataIndex getPerceptualHash:&hash forAssetURL:assetURL]) {
+        return @[];
+    }
+    NSMutableArray *similarURLs = [NSMutableArray array];
+    for (NSURL *similarURL in [self.metadataIndex assetURLsWithPerceptualHash:hash maximumDistance:distance]) {
+        if (![similarURL isEqual:assetURL] && [self indexOfAssetWithURL:similarURL] != NSNotFound) {
+            [similarURLs addObject:similarURL];
+        }
+    }
+    [similarURLs sortUsingComparator:^NSComparisonResult(NSURL *url1, NSURL *url2) {
+        NSUInteger index1 = [self indexOfAssetWithURL:url1];
+        NSUInteger index2 = [self indexOfAssetWithURL:url2];
+        return index1 < index2 ? NSOrderedAscending : (index1 > index2 ? NSOrderedDescending : NSOrderedSame);
+    }];
+    return similarURLs;
 }
 
 - (void)fullScreenImageForAsset:(ALAsset *)asset withCompletion:(void (^)(UIImage *image))completion {
-    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+    [[SSImageJobScheduler sharedService] scheduleJobWithPriority:SSImageJobPriorityVisible cost:kFullScreenImageDecodeCost block:^(SSImageJob *job) {
         UIImage *image = [UIImage imageWithCGImage:asset.defaultRepresentation.fullScreenImage];
         if (completion) {
             dispatch_async(dispatch_get_main_queue(), ^{
                 completion(image);
             });
         }
-    });
+    }];
 }
 
 - (void)fullScreenImageForAssetWithURL:(NSURL *)assetURL withCompletion:(void (^)(UIImage *image))completion {
-    [self assetForURL:assetURL withCompletion:^(ALAsset *asset) {
-        [self fullScreenImageForAsset:asset withCompletion:completion];
-    }];
+    UIImage *cachedImage = [self.fullScreenImageCache imageForAssetURL:assetURL];
+    if (cachedImage) {
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(cachedImage);
+            });
+        }
+        return;
+    }
+    [self loadFullScreenImageForAssetWithURL:assetURL completion:completion];
+}
+
+- (void)prefetchFullScreenImagesAroundIndex:(NSUInteger)index {
+    // Work from one copy of the list, so its count and contents agree
+    NSArray *assetURLs = self.assetURLs;
+    NSUInteger numberOfAssets = assetURLs.count;
+    if (index == NSNotFound || index >= numberOfAssets) {
+        return;
+    }
+    
+    self.fullScreenImageCache.pinnedAssetURL = assetURLs[index];
+    
+    // Nearest neighbours first
+    NSMutableArray *neighbourURLs = [NSMutableArray array];
+    for (NSInteger distance = 1; distance <= kFullScreenImagePrefetchDistance; distance++) {
+        for (NSInteger direction = 1; direction >= -1; direction -= 2) {
+            NSInteger neighbourIndex = (NSInteger)index + direction * distance;
+            if (neighbourIndex < 0 || neighbourIndex >= (NSInteger)numberOfAssets) {
+                continue;
+            }
+            NSURL *neighbourURL = assetURLs[neighbourIndex];
+            if (neighbourURL) {
+                [neighbourURLs addObject:neighbourURL];
+            }
+        }
+    }
+    
+    // Cancel prefetches for pages the user has swiped away from, unless someone has
+    // asked for the image since. The current page is still wanted even before anyone has.
+    NSMutableSet *wantedURLs = [NSMutableSet setWithArray:neighbourURLs];
+    [wantedURLs addObject:assetURLs[index]];
+    @synchronized(self.fullScreenImageCompletionsByURL) {
+        for (NSURL *assetURL in [self.fullScreenImageCompletionsByURL allKeys]) {
+            if ([self.fullScreenImageCompletionsByURL[assetURL] count] == 0 && ![wantedURLs containsObject:assetURL]) {
+                [self.fullScreenImageJobsByURL[assetURL] cancel];
+                [self.fullScreenImageJobsByURL removeObjectForKey:assetURL];
+                [self.fullScreenImageCompletionsByURL removeObjectForKey:assetURL];
+            }
+        }
+    }
+    
+    for (NSURL *assetURL in neighbourURLs) {
+        if (![self.fullScreenImageCache imageForAssetURL:assetURL]) {
+            [self loadFullScreenImageForAssetWithURL:assetURL completion:nil];
+        }
+    }
 }
 
 - (void)fullResolutionImageForAsset:(ALAsset *)asset withCompletion:(void (^)(UIImage *))completion {
-    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+    // The decoded image plus the filtered copy made from it
+    CGSize dimensions = asset.defaultRepresentation.dimensions;
+    NSUInteger cost = (NSUInteger)(dimensions.width * dimensions.height) * 4 * 2;
+    [[SSImageJobScheduler sharedService] scheduleJobWithPriority:SSImageJobPriorityVisible cost:cost block:^(SSImageJob *job) {
         UIImage *image = [asset defaultRepresentationFullSizeFilteredImage];
         if (completion) {
             dispatch_async(dispatch_get_main_queue(), ^{
                 completion(image);
             });
         }
-    });
+    }];
 }
 
 - (void)fullResolutionImageForAssetWithURL:(NSURL *)assetURL withCompletion:(void (^)(UIImage *))completion {
-    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
-        // Look up ALAsset, then call our -fullResolutionImageForAsset:withCompletion: method
-        // to retrieve and cache the full resolution image
-        [self.assetsLibrary assetForURL:assetURL resultBlock:^(ALAsset *asset) {
-            [self fullResolutionImageForAsset:asset withCompletion:completion];
-        } failureBlock:^(NSError *error) {
-            DDLogError(@"Unable to retrieve asset for URL: %@", assetURL);
-            if (completion) {
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    completion(nil);
-                });
-            }
-        }];
-    });
+    // Look up ALAsset, then call our -fullResolutionImageForAsset:withCompletion: method
+    // to retrieve and cache the full resolution image
+    [self.assetsLibrary assetForURL:assetURL resultBlock:^(ALAsset *asset) {
+        [self fullResolutionImageForAsset:asset withCompletion:completion];
+    } failureBlock:^(NSError *error) {
+        DDLogError(@"Unable to retrieve asset for URL: %@", assetURL);
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(nil);
+            });
+        }
+    }];
 }
 
 #pragma mark - Properties
 
+- (NSArray *)assetURLs {
+    @synchronized(self) {
+        return _assetURLs;
+    }
+}
+
+- (void)setAssetURLs:(NSArray *)assetURLs {
+    // Keep URL -> index lookup table in sync with the chronological list so that
+    // -indexOfAssetWithURL: doesn't need to scan the whole array on every page turn
+    NSArray *immutableURLs = [assetURLs copy];
+    NSDictionary *indexesByURL = [[[self class] indexesByURLForAssetURLs:immutableURLs] copy];
+    @synchronized(self) {
+        _assetURLs = immutableURLs;
+        _assetIndexesByURL = indexesByURL;
+    }
+    self.snapshotIsStale = YES;
+}
+
+- (NSDictionary *)assetIndexesByURL {
+    @synchronized(self) {
+        return _assetIndexesByURL;
+    }
+}
+
 - (NSUInteger)numberOfAssets {
     return self.assetURLs.count;
 }
 
 #pragma mark - Private methods
 
++ (NSMutableDictionary *)indexesByURLForAssetURLs:(NSArray *)assetURLs {
+    NSMutableDictionary *indexesByURL = [NSMutableDictionary dictionaryWithCapacity:assetURLs.count];
+    [assetURLs enumerateObjectsUsingBlock:^(NSURL *url, NSUInteger idx, BOOL *stop) {
+        // First occurrence wins, matching -[NSArray indexOfObject:]
+        if (!indexesByURL[url]) {
+            indexesByURL[url] = @(idx);
+        }
+    }];
+    return indexesByURL;
+}
+
+- (void)appendAssetURLs:(NSArray *)assetURLs {
+    // Copy on append: readers may still be using the current list and table
+    NSArray *currentURLs;
+    NSDictionary *currentIndexesByURL;
+    @synchronized(self) {
+        currentURLs = _assetURLs;
+        currentIndexesByURL = _assetIndexesByURL;
+    }
+    NSMutableDictionary *indexesByURL = [NSMutableDictionary dictionaryWithDictionary:currentIndexesByURL];
+    NSUInteger idx = currentURLs.count;
+    for (NSURL *url in assetURLs) {
+        if (!indexesByURL[url]) {
+            indexesByURL[url] = @(idx);
+        }
+        idx++;
+    }
+    NSArray *updatedURLs = [currentURLs arrayByAddingObjectsFromArray:assetURLs];
+    @synchronized(self) {
+        _assetURLs = updatedURLs;
+        _assetIndexesByURL = [indexesByURL copy];
+    }
+    self.snapshotIsStale = YES;
+}
+
+- (void)rescanAssets {
+    // Most library changes are new photos arriving at the newest end of the camera roll.
+    // Scan only until the newest known asset is reached; if the group count and oldest
+    // asset still line up, the rest of the list is unchanged and can be kept as is.
+    // Anything else falls back to a full pass.
+    NSURL *newestKnownURL = [self.assetURLs firstObject];
+    NSURL *oldestKnownURL = [self.assetURLs lastObject];
+    if (!newestKnownURL) {
+        [self enumerateAssetsWithCompletion:nil];
+        return;
+    }
+    
+    __block typeof(self) bSelf = self;
+    NSMutableArray *newURLs = [NSMutableArray array];
+    __block BOOL foundNewestKnownURL = NO;
+    __block BOOL oldestUnchanged = NO;
+    __block NSUInteger numberOfAssetsInGroup = 0;
+    _enumeratingAssets = YES;
+    
+    DDLogVerbose(@"Rescanning newest assets");
+    
+    [self.assetsLibrary enumerateGroupsWithTypes:ALAssetsGroupSavedPhotos usingBlock:^(ALAssetsGroup *group, BOOL *groupStop) {
+        if (group) {
+            numberOfAssetsInGroup = group.numberOfAssets;
+            [group enumerateAssetsWithOptions:NSEnumerationReverse usingBlock:^(ALAsset *result, NSUInteger index, BOOL *stop) {
+                NSURL *url = result.defaultURL;
+                if (!url) {
+                    return;
+                }
+                if ([url isEqual:newestKnownURL]) {
+                    foundNewestKnownURL = YES;
+                    *stop = YES;
+                } else {
+                    [newURLs addObject:url];
+                }
+            }];
+            if (foundNewestKnownURL && numberOfAssetsInGroup > 0) {
+                [group enumerateAssetsAtIndexes:[NSIndexSet indexSetWithIndex:0] options:0 usingBlock:^(ALAsset *result, NSUInteger index, BOOL *stop) {
+                    if (result) {
+                        oldestUnchanged = [result.defaultURL isEqual:oldestKnownURL];
+                    }
+                }];
+            }
+        } else {
+            if (foundNewestKnownURL && oldestUnchanged && newURLs.count + bSelf.assetURLs.count == numberOfAssetsInGroup) {
+                DDLogVerbose(@"Found %lu new assets", (unsigned long)newURLs.count);
+                if (newURLs.count > 0) {
+                    NSMutableArray *mutableURLs = [NSMutableArray arrayWithArray:newURLs];
+                    [mutableURLs addObjectsFromArray:bSelf.assetURLs];
+                    bSelf.assetURLsBeforeEnumeration = bSelf.assetURLs;
+                    bSelf.assetURLs = mutableURLs;
+                    [bSelf checkAssetsForChanges];
+                }
+                [bSelf finishEnumeration];
+            } else {
+                DDLogVerbose(@"Assets changed beyond the newest end; enumerating all assets");
+                bSelf->_enumeratingAssets = NO;
+                [bSelf enumerateAssetsWithCompletion:nil];
+            }
+        }
+    } failureBlock:^(NSError *error) {
+        DDLogError(@"Error rescanning assets: %@", error);
+        [bSelf finishEnumeration];
+    }];
+}
+
+- (void)finishEnumeration {
+    _enumeratingAssets = NO;
+    
+    if (self.snapshotIsStale) {
+        [self writeSnapshot];
+    }
+    
+    [self updateMetadataIndex];
+    
+    NSArray *completions = [self.enumerationCompletions copy];
+    [self.enumerationCompletions removeAllObjects];
+    for (void (^completion)(NSUInteger) in completions) {
+        completion(self.assetURLs.count);
+    }
+    
+    // Changes that arrived mid-pass are picked up by a single follow-up scan rather than
+    // by restarting the pass, so continuous syncing can't starve enumeration.
+    if (self.assetsHaveChanged) {
+        self.assetsHaveChanged = NO;
+        [self rescanAssets];
+    }
+}
+
+- (void)loadFullScreenImageForAssetWithURL:(NSURL *)assetURL completion:(void (^)(UIImage *image))completion {
+    if (!assetURL) {
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(nil);
+            });
+        }
+        return;
+    }
+    
+    // Join a load that's already in flight for this URL rather than decoding twice
+    NSMutableArray *completions;
+    @synchronized(self.fullScreenImageCompletionsByURL) {
+        completions = self.fullScreenImageCompletionsByURL[assetURL];
+        BOOL alreadyLoading = (completions != nil);
+        if (!alreadyLoading) {
+            completions = [NSMutableArray array];
+            self.fullScreenImageCompletionsByURL[assetURL] = completions;
+        }
+        if (completion) {
+            [completions addObject:[completion copy]];
+            // Someone is waiting on it now, so it's no longer just a prefetch
+            [self.fullScreenImageJobsByURL[assetURL] setPriority:SSImageJobPriorityVisible];
+        }
+        if (alreadyLoading) {
+            return;
+        }
+    }
+    
+    [self assetForURL:assetURL withCompletion:^(ALAsset *asset) {
+        @synchronized(self.fullScreenImageCompletionsByURL) {
+            if (self.fullScreenImageCompletionsByURL[assetURL] != completions) {
+                // Prefetch was cancelled while the asset was being looked up
+                return;
+            }
+            SSImageJobPriority priority = (completions.count > 0) ? SSImageJobPriorityVisible : SSImageJobPriorityPrefetch;
+            self.fullScreenImageJobsByURL[assetURL] = [[SSImageJobScheduler sharedService] scheduleJobWithPriority:priority cost:kFullScreenImageDecodeCost block:^(SSImageJob *job) {
+                [self decodeFullScreenImageForAsset:asset assetURL:assetURL job:job];
+            }];
+        }
+    }];
+}
+
+- (void)decodeFullScreenImageForAsset:(ALAsset *)asset assetURL:(NSURL *)assetURL job:(SSImageJob *)job {
+    UIImage *image = nil;
+    if (asset) {
+        CGImageRef fullScreenImage = asset.defaultRepresentation.fullScreenImage;
+        image = [UIImage imageWithCGImage:fullScreenImage];
+        [self.fullScreenImageCache setImage:image forAssetURL:assetURL];
+        
+        // Hashing the image we've already decoded is cheap; do it while we have it
+        uint64_t hash;
+        if ([self.metadataIndex hasMetadataForAssetURL:assetURL] && ![self.metadataIndex getPerceptualHash:NULL forAssetURL:assetURL]
+            && [SSAssetMetadataIndex getPerceptualHash:&hash forImage:fullScreenImage]) {
+            [self.metadataIndex setPerceptualHash:hash forAssetURL:assetURL];
+        }
+    }
+    
+    NSArray *completions = nil;
+    @synchronized(self.fullScreenImageCompletionsByURL) {
+        // If this prefetch was cancelled mid-decode, a newer load may own the entry now
+        if (self.fullScreenImageJobsByURL[assetURL] == job) {
+            completions = self.fullScreenImageCompletionsByURL[assetURL];
+            [self.fullScreenImageCompletionsByURL removeObjectForKey:assetURL];
+            [self.fullScreenImageJobsByURL removeObjectForKey:assetURL];
+        }
+    }
+    if (completions.count > 0) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            for (void (^completion)(UIImage *) in completions) {
+                completion(image);
+            }
+        });
+    }
+}
+
+- (void)didReceiveMemoryWarning:(NSNotification *)notification {
+    DDLogVerbose(@"Memory warning; clearing full screen image cache");
+    [self.fullScreenImageCache removeAllImages];
+}
+
+- (void)restoreSnapshot {
+    NSError *error = nil;
+    NSString *path = [SSAssetCatalogSnapshot defaultPath];
+    SSAssetCatalogSnapshot *snapshot = [[SSAssetCatalogSnapshot alloc] initWithContentsOfFile:path error:&error];
+    if (!snapshot) {
+        if ([error.domain isEqualToString:SSAssetCatalogSnapshotErrorDomain]) {
+            DDLogError(@"Discarding unreadable asset catalog snapshot: %@", error);
+            [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+        }
+        return;
+    }
+    DDLogVerbose(@"Restored %lu assets from catalog snapshot", (unsigned long)snapshot.count);
+    
+    // Serve the snapshot's URLs as they are parsed on demand, so startup doesn't scale with the
+    // size of the library. The checksum, URL lookup table and metadata come in the background.
+    NSArray *restoredURLs = snapshot.assetURLs;
+    @synchronized(self) {
+        _assetURLs = restoredURLs;
+        _assetIndexesByURL = nil;
+    }
+    self.snapshotIsStale = NO;
+    
+    dispatch_async(self.metadataIndexQueue, ^{
+        NSError *validationError = nil;
+        if (![snapshot validateContents:&validationError]) {
+            DDLogError(@"Discarding corrupt asset catalog snapshot: %@", validationError);
+            [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (self.assetURLs != restoredURLs) {
+                    // Already replaced by an enumeration
+                    return;
+                }
+                self.assetURLs = @[];
+                NSDictionary *userInfo = @{
+                                           SSChronologicalAssetsLibraryInsertedAssetIndexesKey: [NSIndexSet indexSet],
+                                           SSChronologicalAssetsLibraryDeletedAssetIndexesKey: [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, restoredURLs.count)],
+                                           SSChronologicalAssetsLibraryMovedAssetIndexesKey: [NSIndexSet indexSet],
+                                           };
+                [[NSNotificationCenter defaultCenter] postNotificationName:SSChronologicalAssetsLibraryUpdatedNotification object:self userInfo:userInfo];
+            });
+            return;
+        }
+        NSDictionary *indexesByURL = [[[self class] indexesByURLForAssetURLs:restoredURLs] copy];
+        @synchronized(self) {
+            if (_assetURLs == restoredURLs) {
+                _assetIndexesByURL = indexesByURL;
+            }
+        }
+        [self.metadataIndex restoreFromSnapshot:snapshot];
+    });
+}
+
+- (void)writeSnapshot {
+    self.snapshotIsStale = NO;
+    NSArray *assetURLs = [self.assetURLs copy];
+    [[SSImageJobScheduler sharedService] scheduleJobWithPriority:SSImageJobPriorityIndexing cost:0 block:^(SSImageJob *job) {
+        NSArray *timestamps = nil;
+        NSArray *flags = nil;
+        NSArray *perceptualHashes = nil;
+        NSArray *dimensions = nil;
+        [self.metadataIndex getSnapshotTimestamps:&timestamps flags:&flags perceptualHashes:&perceptualHashes dimensions:&dimensions forAssetURLs:assetURLs];
+        NSError *error = nil;
+        if (![SSAssetCatalogSnapshot writeAssetURLs:assetURLs timestamps:timestamps flags:flags perceptualHashes:perceptualHashes dimensions:dimensions toFile:[SSAssetCatalogSnapshot defaultPath] error:&error]) {
+            DDLogError(@"Unable to write asset catalog snapshot: %@", error);
+        }
+    }];
+}
+
+- (void)updateMetadataIndex {
+    // Drop deleted assets, then read metadata for new ones a batch at a time in the background.
+    // A newer pass supersedes one still in progress.
+    NSArray *assetURLs = [self.assetURLs copy];
+    NSUInteger generation = ++self.metadataIndexGeneration;
+    dispatch_async(self.metadataIndexQueue, ^{
+        [self.metadataIndex removeAssetURLsNotInArray:assetURLs];
+        // Assets are hashed when their metadata is read, so one with metadata but no hash couldn't
+        // be hashed; don't decode its thumbnail again on every pass
+        NSMutableArray *unindexedURLs = [NSMutableArray array];
+        for (NSURL *assetURL in assetURLs) {
+            if (![self.metadataIndex hasMetadataForAssetURL:assetURL]) {
+                [unindexedURLs addObject:assetURL];
+            }
+        }
+        if (unindexedURLs.count > 0) {
+            DDLogVerbose(@"Indexing metadata for %lu assets", (unsigned long)unindexedURLs.count);
+            [self indexMetadataForAssetURLs:unindexedURLs fromIndex:0 generation:generation];
+        }
+    });
+}
+
+- (void)indexMetadataForAssetURLs:(NSArray *)assetURLs fromIndex:(NSUInteger)start generation:(NSUInteger)generation {
+    // Must be called on metadataIndexQueue
+    if (generation != self.metadataIndexGeneration) {
+        return;
+    }
+    if (start >= assetURLs.count) {
+        DDLogVerbose(@"Finished indexing metadata");
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self writeSnapshot];
+        });
+        return;
+    }
+    
+    NSUInteger end = MIN(start + kMetadataIndexBatchSize, assetURLs.count);
+    dispatch_group_t group = dispatch_group_create();
+    for (NSUInteger idx = start; idx < end; idx++) {
+        NSURL *assetURL = assetURLs[idx];
+        dispatch_group_enter(group);
+        [self assetForURL:assetURL withCompletion:^(ALAsset *asset) {
+            // Reading metadata parses the file; keep it off the main thread, and out of the way
+            // of images the user is waiting for
+            [[SSImageJobScheduler sharedService] scheduleJobWithPriority:SSImageJobPriorityIndexing cost:0 block:^(SSImageJob *job) {
+                if (asset && generation == self.metadataIndexGeneration) {
+                    if (![self.metadataIndex hasMetadataForAssetURL:assetURL]) {
+                        [self.metadataIndex setMetadata:[SSAssetMetadataIndex metadataForAsset:asset] forAssetURL:assetURL];
+                    }
+                    // The aspect ratio thumbnail is much cheaper than the full screen image, and
+                    // downscales to the same hash give or take a bit. Some assets, such as certain
+                    // videos, have no thumbnail; they are left unhashed rather than all matching.
+                    uint64_t hash;
+                    if (![self.metadataIndex getPerceptualHash:NULL forAssetURL:assetURL]
+                        && [SSAssetMetadataIndex getPerceptualHash:&hash forImage:asset.aspectRatioThumbnail]) {
+                        [self.metadataIndex setPerceptualHash:hash forAssetURL:assetURL];
+                    }
+                }
+                dispatch_group_leave(group);
+            }];
+        }];
+    }
+    dispatch_group_notify(group, self.metadataIndexQueue, ^{
+        [self indexMetadataForAssetURLs:assetURLs fromIndex:end generation:generation];
+    });
+}
+
 - (void)assetsChangedWithNotification:(NSNotification *)notification {
     DDLogVerbose(@"Assets changed! Notification: %@", notification);
     
@@ -224,57 +745,103 @@ NSString * const SSChronologicalAssetsLibraryDeletedAssetIndexesKey = @"SSChrono
         return;
     }
     
-    // Set flag indicating assets have changed;
-    // after enumeration is finished, assets will be compared and notifications
-    // will be sent.
+    // Set flag indicating assets have changed; if a pass is in progress, a rescan
+    // will be triggered once it's finished.
     self.assetsHaveChanged = YES;
     
-    if (self.assetURLsBeforeEnumeration == nil) {
-        // Store asset URLs prior to enumeration
-        self.assetURLsBeforeEnumeration = [NSArray arrayWithArray:self.assetURLs];
-    }
-
-    if (_enumeratingAssets) {
-        // Restart enumeration if it's already in progress
-        self.restartAssetEnumeration = YES;
-        return;
-    } else {
-        // Trigger a new enumeration
-        [self enumerateAssetsWithCompletion:nil];
+    if (!_enumeratingAssets) {
+        self.assetsHaveChanged = NO;
+        [self rescanAssets];
     }
 }
 
 - (void)checkAssetsForChanges {
     DDLogVerbose(@"checkAssetsForChanges");
     
-    // Compare old and new asset URLs; track which indexes have been added and removed
-    NSMutableSet *oldAssetURLs = [NSMutableSet setWithArray:self.assetURLsBeforeEnumeration];
-    NSMutableSet *newAssetURLs = [NSMutableSet set];
-    for (NSURL *url in self.assetURLs) {
-        if ([oldAssetURLs containsObject:url]) {
-            [oldAssetURLs removeObject:url];
-        } else {
-            [newAssetURLs addObject:url];
+    // Compare old and new asset URLs; track which indexes have been added, removed and moved.
+    // Each list is walked once, using the URL -> index tables for membership tests.
+    NSArray *oldAssetURLs = self.assetURLsBeforeEnumeration;
+    NSArray *newAssetURLs = self.assetURLs;
+    NSDictionary *oldIndexesByURL = [[self class] indexesByURLForAssetURLs:oldAssetURLs];
+    NSDictionary *newIndexesByURL = self.assetIndexesByURL;
+    
+    NSMutableIndexSet *removedAssetIndexes = [NSMutableIndexSet indexSet];
+    [oldAssetURLs enumerateObjectsUsingBlock:^(NSURL *url, NSUInteger idx, BOOL *stop) {
+        if (!newIndexesByURL[url]) {
+            [removedAssetIndexes addIndex:idx];
         }
-    }
+    }];
     
     NSMutableIndexSet *addedAssetIndexes = [NSMutableIndexSet indexSet];
-    for (NSURL *addedURL in newAssetURLs) {
-        [addedAssetIndexes addIndex:[self.assetURLs indexOfObject:addedURL]];
-    }
-    
-    NSMutableIndexSet *removedAssetIndexes = [NSMutableIndexSet indexSet];
-    for (NSURL *removedURL in oldAssetURLs) {
-        [removedAssetIndexes addIndex:[self.assetURLsBeforeEnumeration indexOfObject:removedURL]];
+    NSUInteger *survivorNewIndexes = malloc(MAX(newAssetURLs.count, 1) * sizeof(NSUInteger));
+    NSUInteger *survivorOldIndexes = malloc(MAX(newAssetURLs.count, 1) * sizeof(NSUInteger));
+    NSUInteger survivorCount = 0;
+    for (NSUInteger newIdx = 0; newIdx < newAssetURLs.count; newIdx++) {
+        NSNumber *oldIdx = oldIndexesByURL[newAssetURLs[newIdx]];
+        if (!oldIdx) {
+            [addedAssetIndexes addIndex:newIdx];
+            continue;
+        }
+        survivorNewIndexes[survivorCount] = newIdx;
+        survivorOldIndexes[survivorCount] = [oldIdx unsignedIntegerValue];
+        survivorCount++;
     }
+    NSIndexSet *movedAssetIndexes = [[self class] movedIndexesForNewIndexes:survivorNewIndexes oldIndexes:survivorOldIndexes count:survivorCount];
+    free(survivorNewIndexes);
+    free(survivorOldIndexes);
     
     NSDictionary *userInfo = @{
                                SSChronologicalAssetsLibraryInsertedAssetIndexesKey: addedAssetIndexes,
                                SSChronologicalAssetsLibraryDeletedAssetIndexesKey: removedAssetIndexes,
+                               SSChronologicalAssetsLibraryMovedAssetIndexesKey: movedAssetIndexes,
                                };
     [[NSNotificationCenter defaultCenter] postNotificationName:SSChronologicalAssetsLibraryUpdatedNotification object:self userInfo:userInfo];
     
     self.assetURLsBeforeEnumeration = nil;
 }
 
++ (NSIndexSet *)movedIndexesForNewIndexes:(const NSUInteger *)newIndexes oldIndexes:(const NSUInteger *)oldIndexes count:(NSUInteger)count {
+    // The assets that kept their relative order are the longest increasing run of old indexes,
+    // taken in new order; only the rest need to be reported as moved. Patience sorting finds
+    // that run in O(n log n): tails[k] is the survivor ending the best run of length k + 1.
+    NSMutableIndexSet *movedIndexes = [NSMutableIndexSet indexSet];
+    if (count == 0) {
+        return movedIndexes;
+    }
+    NSUInteger *tails = malloc(count * sizeof(NSUInteger));
+    NSUInteger *predecessors = malloc(count * sizeof(NSUInteger));
+    NSUInteger length = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        NSUInteger low = 0;
+        NSUInteger high = length;
+        while (low < high) {
+            NSUInteger mid = low + (high - low) / 2;
+            if (oldIndexes[tails[mid]] < oldIndexes[i]) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        predecessors[i] = (low > 0) ? tails[low - 1] : NSNotFound;
+        tails[low] = i;
+        if (low == length) {
+            length++;
+        }
+    }
+    
+    BOOL *inOrder = calloc(count, sizeof(BOOL));
+    for (NSUInteger i = tails[length - 1]; i != NSNotFound; i = predecessors[i]) {
+        inOrder[i] = YES;
+    }
+    for (NSUInteger i = 0; i < count; i++) {
+        if (!inOrder[i]) {
+            [movedIndexes addIndex:newIndexes[i]];
+        }
+    }
+    free(tails);
+    free(predecessors);
+    free(inOrder);
+    return movedIndexes;
+}
+
 @end
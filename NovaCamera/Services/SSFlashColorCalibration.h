@@ -0,0 +1,49 @@
+//
+//  SSFlashColorCalibration.h
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "SSNovaFlashService.h"
+
+@class SSCapturedImage;
+
+/**
+ * Dimension of the colour cubes returned by `colorCubeDataForFlashSettings:`
+ */
+extern const NSUInteger kFlashColorCubeDimension;
+
+/**
+ * Corrects the colour cast of photos lit by the Nova. Its warm and cool LEDs each have their own
+ * spectrum, which auto white balance only partly compensates for, so the right correction depends
+ * on the mix of the two in a shot. Corrections are defined for a few anchor mixes and interpolated
+ * between them, then baked into a 3D lookup table applied with Core Image's `CIColorCube`. Tables
+ * are built on first use and cached by mix, quantised, for the shots that follow.
+ */
+@interface SSFlashColorCalibration : NSObject
+
++ (id)sharedService;
+
+/**
+ * Fraction, 0-1, of the flash's output that comes from the warm LED with `flashSettings`
+ */
++ (double)warmFractionForFlashSettings:(SSFlashSettings)flashSettings;
+
+/**
+ * Data for a `CIColorCube` filter of dimension `kFlashColorCubeDimension` that corrects photos lit
+ * with `flashSettings`. It maps gamma encoded RGB, so it must be rendered without colour
+ * management. Returns nil if the flash is off or the mix needs no correction.
+ */
+- (NSData *)colorCubeDataForFlashSettings:(SSFlashSettings)flashSettings;
+
+/**
+ * Correct the colour of a photo lit with `flashSettings` on a background queue and re-encode it
+ * with its metadata. `completion` is called on the main queue with the result, or nil if it
+ * needed no correction or couldn't be corrected; then the original should be kept untouched.
+ */
+- (void)correctCapturedImage:(SSCapturedImage *)capturedImage forFlashSettings:(SSFlashSettings)flashSettings completion:(void (^)(SSCapturedImage *correctedImage))completion;
+
+@end
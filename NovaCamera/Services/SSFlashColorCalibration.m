@@ -0,0 +1,273 @@
+//
+//  SSFlashColorCalibration.m
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import "SSFlashColorCalibration.h"
+#import "SSCapturedImage.h"
+#import "SSImageJobScheduler.h"
+#import "SSTraceService.h"
+#import <CoreImage/CoreImage.h>
+#import <ImageIO/ImageIO.h>
+#import <MobileCoreServices/MobileCoreServices.h>
+
+// 32 grid points per channel is within a level of an exact correction for smooth mappings like
+// these; a cube is 512 KB of floats
+const NSUInteger kFlashColorCubeDimension = 32;
+// Mixes are quantised to this many steps between all cool and all warm, which is finer than the
+// correction changes noticeably
+static const NSUInteger kWarmFractionSteps = 32;
+// Number of cubes kept; most people only use one or two flash settings
+static const NSUInteger kCachedCubeCount = 4;
+static const CGFloat kCorrectedJPEGQuality = 0.9;
+// Corrections closer than this to the identity in every matrix entry are skipped
+static const float kIdentityTolerance = 0.001f;
+
+/**
+ * Correction for one mix of the LEDs, in linear RGB: per channel gains, then a colour matrix
+ * (row major) whose rows sum to one so neutrals stay neutral
+ */
+typedef struct {
+    double warmFraction;
+    float gains[3];
+    float matrix[9];
+} SSFlashColorAnchor;
+
+// In order of warm fraction
+static const SSFlashColorAnchor kAnchors[] = {
+    // Cool LED alone: slightly blue-green of neutral
+    { 0.0,       { 1.04f, 0.98f, 0.96f }, { 1.00f, 0.00f, 0.00f,   0.00f, 1.00f, 0.00f,   0.00f, 0.00f, 1.00f } },
+    // Equal mix (Bright, Gentle): close to daylight, which auto white balance handles
+    { 0.5,       { 1.00f, 1.00f, 1.00f }, { 1.00f, 0.00f, 0.00f,   0.00f, 1.00f, 0.00f,   0.00f, 0.00f, 1.00f } },
+    // Two parts warm to one cool (Warm)
+    { 2.0 / 3.0, { 0.96f, 1.00f, 1.07f }, { 0.97f, 0.03f, 0.00f,   0.00f, 0.99f, 0.01f,   0.00f, 0.01f, 0.99f } },
+    // Warm LED alone: amber, with reds oversaturated
+    { 1.0,       { 0.90f, 1.00f, 1.16f }, { 0.94f, 0.05f, 0.01f,   0.01f, 0.98f, 0.01f,   0.00f, 0.03f, 0.97f } },
+};
+
+static inline float SSLinearFromSRGB(float value) {
+    return (value <= 0.04045f) ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static inline float SSSRGBFromLinear(float value) {
+    value = fminf(1.0f, fmaxf(0.0f, value));
+    return (value <= 0.0031308f) ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+}
+
+@interface SSFlashColorCalibration () {
+    // Must be accessed while synchronized
+    NSMutableDictionary *_cubesByStep;
+    NSMutableArray *_recentSteps;
+}
+@property (nonatomic, strong) CIContext *context;
++ (void)getCorrectionMatrix:(float *)matrix forWarmFraction:(double)warmFraction;
++ (BOOL)isIdentityCorrectionForWarmFraction:(double)warmFraction;
++ (NSData *)colorCubeDataForWarmFraction:(double)warmFraction;
+- (void)didReceiveMemoryWarning:(NSNotification *)notification;
+@end
+
+@implementation SSFlashColorCalibration
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        _cubesByStep = [NSMutableDictionary dictionary];
+        _recentSteps = [NSMutableArray array];
+        // The cubes map encoded values, so keep Core Image from converting to linear and back
+        self.context = [CIContext contextWithOptions:@{ kCIContextWorkingColorSpace: [NSNull null] }];
+
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(didReceiveMemoryWarning:) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+}
+
++ (id)sharedService {
+    static id _sharedService;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        _sharedService = [[self alloc] init];
+    });
+    return _sharedService;
+}
+
++ (double)warmFractionForFlashSettings:(SSFlashSettings)flashSettings {
+    uint8_t warm, cool;
+    SSFlashSettingsGetLEDLevels(flashSettings, &warm, &cool);
+    if (warm == 0 && cool == 0) {
+        return 0.5;
+    }
+    return (double)warm / ((double)warm + (double)cool);
+}
+
+- (NSData *)colorCubeDataForFlashSettings:(SSFlashSettings)flashSettings {
+    uint8_t warm, cool;
+    SSFlashSettingsGetLEDLevels(flashSettings, &warm, &cool);
+    if (warm == 0 && cool == 0) {
+        return nil;
+    }
+    NSUInteger step = (NSUInteger)lround([[self class] warmFractionForFlashSettings:flashSettings] * kWarmFractionSteps);
+    if ([[self class] isIdentityCorrectionForWarmFraction:(double)step / kWarmFractionSteps]) {
+        return nil;
+    }
+    NSNumber *key = @(step);
+
+    @synchronized(self) {
+        NSData *cubeData = _cubesByStep[key];
+        if (cubeData) {
+            [_recentSteps removeObject:key];
+            [_recentSteps addObject:key];
+            return cubeData;
+        }
+    }
+
+    // Build outside the lock; if two threads race, both build the same cube
+    SSTraceSpan buildSpan = [[SSTraceService sharedService] beginSpan:@"color.cube"];
+    NSData *cubeData = [[self class] colorCubeDataForWarmFraction:(double)step / kWarmFractionSteps];
+    [[SSTraceService sharedService] endSpan:buildSpan];
+
+    @synchronized(self) {
+        if (!_cubesByStep[key]) {
+            _cubesByStep[key] = cubeData;
+            [_recentSteps addObject:key];
+        }
+        while (_recentSteps.count > kCachedCubeCount) {
+            [_cubesByStep removeObjectForKey:_recentSteps[0]];
+            [_recentSteps removeObjectAtIndex:0];
+        }
+    }
+    return cubeData;
+}
+
+- (void)correctCapturedImage:(SSCapturedImage *)capturedImage forFlashSettings:(SSFlashSettings)flashSettings completion:(void (^)(SSCapturedImage *correctedImage))completion {
+    // Mixes near even, and no flash at all, need no correction; don't pay for a decode and a lossy
+    // re-encode
+    NSUInteger step = (NSUInteger)lround([[self class] warmFractionForFlashSettings:flashSettings] * kWarmFractionSteps);
+    if ([[self class] isIdentityCorrectionForWarmFraction:(double)step / kWarmFractionSteps]) {
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(nil);
+            });
+        }
+        return;
+    }
+    // The decoded image and the corrected copy of it
+    NSUInteger cost = [capturedImage.metadata[(__bridge NSString *)kCGImagePropertyPixelWidth] unsignedIntegerValue] * [capturedImage.metadata[(__bridge NSString *)kCGImagePropertyPixelHeight] unsignedIntegerValue] * 4 * 2;
+    [[SSImageJobScheduler sharedService] scheduleJobWithPriority:SSImageJobPriorityVisible cost:cost block:^(SSImageJob *job) {
+        SSCapturedImage *correctedImage = nil;
+        NSData *cubeData = [self colorCubeDataForFlashSettings:flashSettings];
+        if (cubeData) {
+            SSTraceSpan correctSpan = [[SSTraceService sharedService] beginSpan:@"color.correct"];
+            // The pixels are left in their stored orientation, so the metadata still applies as is
+            CIImage *image = [CIImage imageWithData:capturedImage.imageData];
+            CIFilter *filter = [CIFilter filterWithName:@"CIColorCube"];
+            [filter setValue:@(kFlashColorCubeDimension) forKey:@"inputCubeDimension"];
+            [filter setValue:cubeData forKey:@"inputCubeData"];
+            [filter setValue:image forKey:kCIInputImageKey];
+            CGImageRef cgImage = image ? [self.context createCGImage:filter.outputImage fromRect:image.extent] : NULL;
+
+            if (cgImage) {
+                NSMutableDictionary *properties = [capturedImage.metadata mutableCopy];
+                properties[(__bridge NSString *)kCGImageDestinationLossyCompressionQuality] = @(kCorrectedJPEGQuality);
+                NSMutableData *imageData = [NSMutableData data];
+                CGImageDestinationRef destination = CGImageDestinationCreateWithData((__bridge CFMutableDataRef)imageData, kUTTypeJPEG, 1, NULL);
+                if (destination) {
+                    CGImageDestinationAddImage(destination, cgImage, (__bridge CFDictionaryRef)properties);
+                    if (CGImageDestinationFinalize(destination)) {
+                        correctedImage = [[SSCapturedImage alloc] initWithImageData:imageData];
+                    }
+                    CFRelease(destination);
+                }
+                CGImageRelease(cgImage);
+            }
+            [[SSTraceService sharedService] endSpan:correctSpan];
+            if (!correctedImage) {
+                DDLogError(@"Unable to correct flash colour of captured image");
+            }
+        }
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(correctedImage);
+            });
+        }
+    }];
+}
+
+#pragma mark - Private methods
+
++ (void)getCorrectionMatrix:(float *)matrix forWarmFraction:(double)warmFraction {
+    // Interpolate the correction between the anchors either side of the mix
+    size_t anchorCount = sizeof(kAnchors) / sizeof(kAnchors[0]);
+    size_t upper = 1;
+    while (upper < anchorCount - 1 && kAnchors[upper].warmFraction < warmFraction) {
+        upper++;
+    }
+    const SSFlashColorAnchor *a = &kAnchors[upper - 1];
+    const SSFlashColorAnchor *b = &kAnchors[upper];
+    float t = (float)fmin(1.0, fmax(0.0, (warmFraction - a->warmFraction) / (b->warmFraction - a->warmFraction)));
+
+    // Fold the gains into the matrix, so each grid point is one matrix multiply
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 3; column++) {
+            float gain = a->gains[column] + (b->gains[column] - a->gains[column]) * t;
+            float value = a->matrix[row * 3 + column] + (b->matrix[row * 3 + column] - a->matrix[row * 3 + column]) * t;
+            matrix[row * 3 + column] = value * gain;
+        }
+    }
+}
+
++ (BOOL)isIdentityCorrectionForWarmFraction:(double)warmFraction {
+    float matrix[9];
+    [self getCorrectionMatrix:matrix forWarmFraction:warmFraction];
+    for (int idx = 0; idx < 9; idx++) {
+        float identity = (idx % 4 == 0) ? 1.0f : 0.0f;
+        if (fabsf(matrix[idx] - identity) > kIdentityTolerance) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
++ (NSData *)colorCubeDataForWarmFraction:(double)warmFraction {
+    float matrix[9];
+    [self getCorrectionMatrix:matrix forWarmFraction:warmFraction];
+
+    float linear[kFlashColorCubeDimension];
+    for (NSUInteger idx = 0; idx < kFlashColorCubeDimension; idx++) {
+        linear[idx] = SSLinearFromSRGB((float)idx / (float)(kFlashColorCubeDimension - 1));
+    }
+
+    // CIColorCube layout: RGBA floats, red varying fastest, then green, then blue
+    NSMutableData *cubeData = [NSMutableData dataWithLength:kFlashColorCubeDimension * kFlashColorCubeDimension * kFlashColorCubeDimension * 4 * sizeof(float)];
+    float *cube = cubeData.mutableBytes;
+    for (NSUInteger blue = 0; blue < kFlashColorCubeDimension; blue++) {
+        for (NSUInteger green = 0; green < kFlashColorCubeDimension; green++) {
+            for (NSUInteger red = 0; red < kFlashColorCubeDimension; red++) {
+                float input[3] = { linear[red], linear[green], linear[blue] };
+                for (int channel = 0; channel < 3; channel++) {
+                    const float *row = &matrix[channel * 3];
+                    cube[channel] = SSSRGBFromLinear(row[0] * input[0] + row[1] * input[1] + row[2] * input[2]);
+                }
+                cube[3] = 1.0f;
+                cube += 4;
+            }
+        }
+    }
+    return cubeData;
+}
+
+- (void)didReceiveMemoryWarning:(NSNotification *)notification {
+    DDLogVerbose(@"Memory warning; clearing flash colour cubes");
+    @synchronized(self) {
+        [_cubesByStep removeAllObjects];
+        [_recentSteps removeAllObjects];
+    }
+}
+
+@end
@@ -0,0 +1,33 @@
+//
+//  SSFlashFusion.h
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+/**
+ * Combines a flash photo with an unlit one of the same scene, keeping the colour and mood of the
+ * ambient light but the detail and low noise of the flash shot. The ambient image is smoothed
+ * with a joint bilateral filter that follows edges in the flash image, so its noise is removed
+ * without blurring across them; the flash image's detail, relative to its own filtered version,
+ * is then transferred onto it. Where the flash casts a shadow there's no detail to transfer, and
+ * the filtered ambient image is used instead.
+ *
+ * Filtering is done on copies no larger than a preview frame, since the ambient image is one, and
+ * the result applied to the full resolution flash image as a smooth per-pixel gain. Rows are
+ * processed in parallel.
+ */
+@interface SSFlashFusion : NSObject
+
+/**
+ * Fuse `flashImage` with `ambientImage`, which may be smaller but should have the same framing and
+ * orientation. Small shifts between the two, from handshake, are corrected. Returns an image the
+ * size of `flashImage`, which the caller must release, or NULL if the images couldn't be fused.
+ */
++ (CGImageRef)createFusedImageFromFlashImage:(CGImageRef)flashImage ambientImage:(CGImageRef)ambientImage CF_RETURNS_RETAINED;
+
+@end
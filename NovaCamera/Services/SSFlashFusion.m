@@ -0,0 +1,264 @@
+//
+//  SSFlashFusion.m
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import "SSFlashFusion.h"
+
+// Filtering is done on copies of the images no larger than this on their longest side
+static const size_t kFilterMaxPixelSize = 512;
+// Joint bilateral filter radius and spatial sigma, in filtered pixels, and range sigma, in flash luma levels
+static const int kFilterRadius = 5;
+static const float kFilterSpatialSigma = 2.5f;
+static const float kFilterRangeSigma = 12.0f;
+// Largest shift between the two images that's searched for, in filtered pixels
+static const int kAlignmentSearchRadius = 8;
+// Keeps the ratio of flash detail stable in the darkest parts of the flash image
+static const float kDetailEpsilon = 4.0f;
+// Where the filtered flash luma is below kShadowLow, it's taken to be in the flash's shadow and the
+// ambient image is used as is; above kShadowHigh, flash detail is transferred in full.
+static const float kShadowLow = 12.0f;
+static const float kShadowHigh = 32.0f;
+// Rows of the full resolution image processed per parallel work item
+static const size_t kBandHeight = 64;
+
+// Values kept per filtered pixel and interpolated across the full resolution image: the filtered
+// ambient colour, the gain applied to the flash colour, and how much of the flash to use
+enum {
+    SSFusionAmbient = 0,
+    SSFusionGain = 3,
+    SSFusionFlashWeight = 6,
+    SSFusionChannelCount = 7,
+};
+
+static inline int SSClamp(int value, int minimum, int maximum) {
+    return value < minimum ? minimum : (value > maximum ? maximum : value);
+}
+
+static inline int SSLuma(const uint8_t *pixel) {
+    return (77 * pixel[0] + 150 * pixel[1] + 29 * pixel[2] + 128) >> 8;
+}
+
+// Create an RGBX bitmap context of the given size with `image` drawn into it
+static CGContextRef SSCreateBitmapContextWithImage(CGImageRef image, size_t width, size_t height) {
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, width * 4, colorSpace, kCGBitmapByteOrder32Big | kCGImageAlphaNoneSkipLast);
+    CGColorSpaceRelease(colorSpace);
+    if (context) {
+        CGContextSetInterpolationQuality(context, kCGInterpolationHigh);
+        CGContextDrawImage(context, CGRectMake(0, 0, width, height), image);
+    }
+    return context;
+}
+
+// Gradient magnitude of a bitmap's luma, normalised by its mean so images exposed differently, and
+// lit differently, can be compared by their edges. The caller must free the result.
+static float *SSCreateNormalisedGradient(const uint8_t *pixels, size_t bytesPerRow, int width, int height) {
+    float *gradient = calloc((size_t)width * (size_t)height, sizeof(*gradient));
+    double total = 0;
+    for (int y = 1; y < height - 1; y++) {
+        const uint8_t *row = pixels + (size_t)y * bytesPerRow;
+        for (int x = 1; x < width - 1; x++) {
+            const uint8_t *pixel = row + 4 * x;
+            int value = abs(SSLuma(pixel + 4) - SSLuma(pixel - 4)) + abs(SSLuma(pixel + bytesPerRow) - SSLuma(pixel - bytesPerRow));
+            gradient[(size_t)y * width + x] = value;
+            total += value;
+        }
+    }
+    if (total > 0) {
+        float scale = (float)((double)width * (double)height / total);
+        for (size_t idx = 0; idx < (size_t)width * (size_t)height; idx++) {
+            gradient[idx] *= scale;
+        }
+    }
+    return gradient;
+}
+
+// Find the shift of the ambient image relative to the flash image that best lines up their edges
+static void SSFindAmbientShift(const float *flashGradient, const float *ambientGradient, int width, int height, int *shiftX, int *shiftY) {
+    *shiftX = 0;
+    *shiftY = 0;
+    int margin = kAlignmentSearchRadius + 1;
+    if (width < 4 * margin || height < 4 * margin) {
+        return;
+    }
+    float bestDifference = FLT_MAX;
+    for (int dy = -kAlignmentSearchRadius; dy <= kAlignmentSearchRadius; dy++) {
+        for (int dx = -kAlignmentSearchRadius; dx <= kAlignmentSearchRadius; dx++) {
+            // Every other pixel is plenty to compare edges
+            float difference = 0;
+            for (int y = margin; y < height - margin; y += 2) {
+                const float *flashRow = flashGradient + (size_t)y * width;
+                const float *ambientRow = ambientGradient + (size_t)(y + dy) * width + dx;
+                for (int x = margin; x < width - margin; x += 2) {
+                    difference += fabsf(flashRow[x] - ambientRow[x]);
+                }
+            }
+            // Prefer the smaller shift when two are equally good
+            if (difference < bestDifference || (difference == bestDifference && abs(dx) + abs(dy) < abs(*shiftX) + abs(*shiftY))) {
+                bestDifference = difference;
+                *shiftX = dx;
+                *shiftY = dy;
+            }
+        }
+    }
+}
+
+@implementation SSFlashFusion
+
++ (CGImageRef)createFusedImageFromFlashImage:(CGImageRef)flashImage ambientImage:(CGImageRef)ambientImage {
+    if (!flashImage || !ambientImage) {
+        return NULL;
+    }
+    size_t width = CGImageGetWidth(flashImage);
+    size_t height = CGImageGetHeight(flashImage);
+    if (width == 0 || height == 0) {
+        return NULL;
+    }
+
+    // Copies of both images at the filtering size, with the flash image's aspect ratio
+    double filterScale = MIN(1.0, (double)kFilterMaxPixelSize / (double)MAX(width, height));
+    int filterWidth = MAX(1, (int)lround(width * filterScale));
+    int filterHeight = MAX(1, (int)lround(height * filterScale));
+    CGContextRef flashContext = SSCreateBitmapContextWithImage(flashImage, (size_t)filterWidth, (size_t)filterHeight);
+    CGContextRef ambientContext = SSCreateBitmapContextWithImage(ambientImage, (size_t)filterWidth, (size_t)filterHeight);
+    CGContextRef outputContext = SSCreateBitmapContextWithImage(flashImage, width, height);
+    if (!flashContext || !ambientContext || !outputContext) {
+        CGContextRelease(flashContext);
+        CGContextRelease(ambientContext);
+        CGContextRelease(outputContext);
+        return NULL;
+    }
+    const uint8_t *flashPixels = CGBitmapContextGetData(flashContext);
+    size_t flashBytesPerRow = CGBitmapContextGetBytesPerRow(flashContext);
+    const uint8_t *ambientPixels = CGBitmapContextGetData(ambientContext);
+    size_t ambientBytesPerRow = CGBitmapContextGetBytesPerRow(ambientContext);
+
+    // The ambient image was taken a moment before the flash one, so the camera may have moved
+    int shiftX, shiftY;
+    float *flashGradient = SSCreateNormalisedGradient(flashPixels, flashBytesPerRow, filterWidth, filterHeight);
+    float *ambientGradient = SSCreateNormalisedGradient(ambientPixels, ambientBytesPerRow, filterWidth, filterHeight);
+    SSFindAmbientShift(flashGradient, ambientGradient, filterWidth, filterHeight, &shiftX, &shiftY);
+    free(flashGradient);
+    free(ambientGradient);
+    DDLogVerbose(@"Fusing flash and ambient images; ambient shifted by (%d, %d)", shiftX, shiftY);
+
+    // Filter weights, looked up rather than computed per tap
+    int taps = 2 * kFilterRadius + 1;
+    float *spatialWeights = malloc((size_t)(taps * taps) * sizeof(*spatialWeights));
+    for (int j = -kFilterRadius; j <= kFilterRadius; j++) {
+        for (int i = -kFilterRadius; i <= kFilterRadius; i++) {
+            spatialWeights[(j + kFilterRadius) * taps + (i + kFilterRadius)] = expf(-(float)(i * i + j * j) / (2.0f * kFilterSpatialSigma * kFilterSpatialSigma));
+        }
+    }
+    float rangeWeights[256];
+    for (int difference = 0; difference < 256; difference++) {
+        rangeWeights[difference] = expf(-(float)(difference * difference) / (2.0f * kFilterRangeSigma * kFilterRangeSigma));
+    }
+    uint8_t *flashLuma = malloc((size_t)filterWidth * (size_t)filterHeight);
+    for (int y = 0; y < filterHeight; y++) {
+        for (int x = 0; x < filterWidth; x++) {
+            flashLuma[(size_t)y * filterWidth + x] = (uint8_t)SSLuma(flashPixels + (size_t)y * flashBytesPerRow + 4 * x);
+        }
+    }
+
+    // Filter both images with the same weights, which follow the flash image's edges, and work
+    // out for each pixel how its flash colour should be mapped
+    float *samples = malloc((size_t)filterWidth * (size_t)filterHeight * SSFusionChannelCount * sizeof(*samples));
+    dispatch_apply((size_t)filterHeight, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t row) {
+        int y = (int)row;
+        for (int x = 0; x < filterWidth; x++) {
+            int centreLuma = flashLuma[(size_t)y * filterWidth + x];
+            float weightSum = 0;
+            float flashSum[3] = { 0, 0, 0 };
+            float ambientSum[3] = { 0, 0, 0 };
+            for (int j = -kFilterRadius; j <= kFilterRadius; j++) {
+                int ty = SSClamp(y + j, 0, filterHeight - 1);
+                int ay = SSClamp(ty + shiftY, 0, filterHeight - 1);
+                const float *spatialRow = spatialWeights + (j + kFilterRadius) * taps + kFilterRadius;
+                for (int i = -kFilterRadius; i <= kFilterRadius; i++) {
+                    int tx = SSClamp(x + i, 0, filterWidth - 1);
+                    int ax = SSClamp(tx + shiftX, 0, filterWidth - 1);
+                    float weight = spatialRow[i] * rangeWeights[abs(flashLuma[(size_t)ty * filterWidth + tx] - centreLuma)];
+                    const uint8_t *flash = flashPixels + (size_t)ty * flashBytesPerRow + 4 * tx;
+                    const uint8_t *ambient = ambientPixels + (size_t)ay * ambientBytesPerRow + 4 * ax;
+                    for (int c = 0; c < 3; c++) {
+                        flashSum[c] += weight * flash[c];
+                        ambientSum[c] += weight * ambient[c];
+                    }
+                    weightSum += weight;
+                }
+            }
+
+            float *sample = samples + ((size_t)y * filterWidth + x) * SSFusionChannelCount;
+            for (int c = 0; c < 3; c++) {
+                float flashBase = flashSum[c] / weightSum;
+                float ambientBase = ambientSum[c] / weightSum;
+                sample[SSFusionAmbient + c] = ambientBase;
+                // Flash colour times this is the filtered ambient colour times the flash detail
+                sample[SSFusionGain + c] = (ambientBase + kDetailEpsilon) / (flashBase + kDetailEpsilon);
+            }
+            float flashBaseLuma = (0.299f * flashSum[0] + 0.587f * flashSum[1] + 0.114f * flashSum[2]) / weightSum;
+            sample[SSFusionFlashWeight] = fminf(1.0f, fmaxf(0.0f, (flashBaseLuma - kShadowLow) / (kShadowHigh - kShadowLow)));
+        }
+    });
+    free(spatialWeights);
+    free(flashLuma);
+    CGContextRelease(flashContext);
+    CGContextRelease(ambientContext);
+
+    // Apply to the full resolution flash image, interpolating the filtered values bilinearly
+    uint8_t *outputPixels = CGBitmapContextGetData(outputContext);
+    size_t outputBytesPerRow = CGBitmapContextGetBytesPerRow(outputContext);
+    int *columns = malloc(width * 2 * sizeof(*columns));
+    float *columnFractions = malloc(width * sizeof(*columnFractions));
+    for (size_t x = 0; x < width; x++) {
+        float filterX = fmaxf(0.0f, ((float)x + 0.5f) * (float)filterWidth / (float)width - 0.5f);
+        columns[2 * x] = MIN((int)filterX, filterWidth - 1);
+        columns[2 * x + 1] = MIN(columns[2 * x] + 1, filterWidth - 1);
+        columnFractions[x] = fminf(1.0f, filterX - (float)columns[2 * x]);
+    }
+    size_t bandCount = (height + kBandHeight - 1) / kBandHeight;
+    dispatch_apply(bandCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t band) {
+        size_t y1 = MIN((band + 1) * kBandHeight, height);
+        for (size_t y = band * kBandHeight; y < y1; y++) {
+            float filterY = fmaxf(0.0f, ((float)y + 0.5f) * (float)filterHeight / (float)height - 0.5f);
+            int row0 = MIN((int)filterY, filterHeight - 1);
+            int row1 = MIN(row0 + 1, filterHeight - 1);
+            float rowFraction = fminf(1.0f, filterY - (float)row0);
+            const float *samples0 = samples + (size_t)row0 * filterWidth * SSFusionChannelCount;
+            const float *samples1 = samples + (size_t)row1 * filterWidth * SSFusionChannelCount;
+            uint8_t *pixel = outputPixels + y * outputBytesPerRow;
+            for (size_t x = 0; x < width; x++, pixel += 4) {
+                const float *s00 = samples0 + columns[2 * x] * SSFusionChannelCount;
+                const float *s01 = samples0 + columns[2 * x + 1] * SSFusionChannelCount;
+                const float *s10 = samples1 + columns[2 * x] * SSFusionChannelCount;
+                const float *s11 = samples1 + columns[2 * x + 1] * SSFusionChannelCount;
+                float fx = columnFractions[x];
+                float value[SSFusionChannelCount];
+                for (int k = 0; k < SSFusionChannelCount; k++) {
+                    float top = s00[k] + (s01[k] - s00[k]) * fx;
+                    float bottom = s10[k] + (s11[k] - s10[k]) * fx;
+                    value[k] = top + (bottom - top) * rowFraction;
+                }
+                float flashWeight = value[SSFusionFlashWeight];
+                for (int c = 0; c < 3; c++) {
+                    float fused = flashWeight * pixel[c] * value[SSFusionGain + c] + (1.0f - flashWeight) * value[SSFusionAmbient + c];
+                    pixel[c] = (uint8_t)SSClamp((int)lrintf(fused), 0, 255);
+                }
+            }
+        }
+    });
+    free(columns);
+    free(columnFractions);
+    free(samples);
+
+    CGImageRef fusedImage = CGBitmapContextCreateImage(outputContext);
+    CGContextRelease(outputContext);
+    return fusedImage;
+}
+
+@end
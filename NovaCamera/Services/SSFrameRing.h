@@ -0,0 +1,75 @@
+//
+//  SSFrameRing.h
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreVideo/CoreVideo.h>
+
+/**
+ * Keeps copies of the most recent video frames, with their timestamps, in a fixed number of
+ * pixel buffers drawn from a pool that's allocated up front. Copying frames out of the capture
+ * pipeline lets AVFoundation recycle its own buffers straight away, so it never drops frames
+ * on our account. Safe to use from any thread.
+ */
+@interface SSFrameRing : NSObject
+
+/**
+ * Number of frames kept
+ */
+@property (nonatomic, readonly) NSUInteger capacity;
+
+/**
+ * Relative sharpness of a frame, for comparing frames of the same scene: the mean squared
+ * horizontal gradient of its luma. Motion blur and missed focus both lower it.
+ */
++ (double)sharpnessOfFrame:(CVPixelBufferRef)frame;
+
+/**
+ * Number of frames callers may hold on to at once, beyond those still in the ring
+ */
+@property (nonatomic, readonly) NSUInteger heldFrameCount;
+
+/**
+ * Create a ring holding the `capacity` most recent frames, for callers holding one frame at a time
+ */
+- (id)initWithCapacity:(NSUInteger)capacity;
+
+/**
+ * Create a ring holding the `capacity` most recent frames. The pool is allowed enough buffers
+ * that callers can hold `heldFrameCount` frames without the ring running out.
+ */
+- (id)initWithCapacity:(NSUInteger)capacity heldFrameCount:(NSUInteger)heldFrameCount;
+
+/**
+ * Copy a frame into the ring, replacing the oldest. `timestamp` is in the `CACurrentMediaTime()`
+ * timebase. `attachments`, such as the sample buffer's {Exif} dictionary, are set on the copy
+ * along with the frame's own, for reading back with CVBufferGetAttachment. Frames whose size or
+ * format differ from the previous ones (e.g. after switching cameras) flush the ring.
+ */
+- (void)addPixelBuffer:(CVPixelBufferRef)pixelBuffer attachments:(NSDictionary *)attachments timestamp:(CFTimeInterval)timestamp;
+
+/**
+ * Find the sharpest of the frames taken within `window` seconds of `time`, preferring the one
+ * closest to `time` when they're equally sharp. Returns NULL if there are none. The caller must
+ * release the returned buffer, and should do so promptly so it can go back into the pool.
+ *
+ * @param timestamp If non-NULL, set to the chosen frame's timestamp
+ */
+- (CVPixelBufferRef)copyFrameNearTime:(CFTimeInterval)time window:(CFTimeInterval)window timestamp:(CFTimeInterval *)timestamp CF_RETURNS_RETAINED;
+
+/**
+ * Copy up to `maximumCount` of the frames taken within `window` seconds of `time` into `frames`,
+ * closest to `time` first. Returns the number of frames copied; the caller must release each.
+ */
+- (NSUInteger)copyFrames:(CVPixelBufferRef *)frames maximumCount:(NSUInteger)maximumCount nearTime:(CFTimeInterval)time window:(CFTimeInterval)window;
+
+/**
+ * Release all frames and the buffer pool
+ */
+- (void)removeAllFrames;
+
+@end
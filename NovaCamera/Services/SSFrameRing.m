@@ -0,0 +1,283 @@
+//
+//  SSFrameRing.m
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import "SSFrameRing.h"
+
+// Sharpness is measured on every kSharpnessRowStep'th row and every other column; plenty to
+// tell a blurred frame from a sharp one
+static const size_t kSharpnessRowStep = 4;
+static const size_t kSharpnessColumnStep = 2;
+
+static void SSCopyPlane(const uint8_t *source, size_t sourceBytesPerRow, uint8_t *destination, size_t destinationBytesPerRow, size_t height) {
+    if (sourceBytesPerRow == destinationBytesPerRow) {
+        memcpy(destination, source, sourceBytesPerRow * height);
+        return;
+    }
+    size_t rowBytes = MIN(sourceBytesPerRow, destinationBytesPerRow);
+    for (size_t y = 0; y < height; y++) {
+        memcpy(destination + y * destinationBytesPerRow, source + y * sourceBytesPerRow, rowBytes);
+    }
+}
+
+static void SSCopyPixelBuffer(CVPixelBufferRef source, CVPixelBufferRef destination) {
+    CVPixelBufferLockBaseAddress(source, kCVPixelBufferLock_ReadOnly);
+    CVPixelBufferLockBaseAddress(destination, 0);
+    if (CVPixelBufferIsPlanar(source)) {
+        size_t planeCount = CVPixelBufferGetPlaneCount(source);
+        for (size_t plane = 0; plane < planeCount; plane++) {
+            SSCopyPlane(CVPixelBufferGetBaseAddressOfPlane(source, plane), CVPixelBufferGetBytesPerRowOfPlane(source, plane),
+                        CVPixelBufferGetBaseAddressOfPlane(destination, plane), CVPixelBufferGetBytesPerRowOfPlane(destination, plane),
+                        CVPixelBufferGetHeightOfPlane(source, plane));
+        }
+    } else {
+        SSCopyPlane(CVPixelBufferGetBaseAddress(source), CVPixelBufferGetBytesPerRow(source),
+                    CVPixelBufferGetBaseAddress(destination), CVPixelBufferGetBytesPerRow(destination),
+                    CVPixelBufferGetHeight(source));
+    }
+    CVPixelBufferUnlockBaseAddress(destination, 0);
+    CVPixelBufferUnlockBaseAddress(source, kCVPixelBufferLock_ReadOnly);
+}
+
+/**
+ * Mean squared horizontal gradient of the frame's luma (the green channel for BGRA frames).
+ * Motion blur and missed focus both flatten gradients, so a higher value means a sharper frame.
+ */
+static double SSPixelBufferSharpness(CVPixelBufferRef buffer) {
+    CVPixelBufferLockBaseAddress(buffer, kCVPixelBufferLock_ReadOnly);
+    const uint8_t *base;
+    size_t bytesPerRow, width, height, pixelStride;
+    if (CVPixelBufferIsPlanar(buffer)) {
+        base = CVPixelBufferGetBaseAddressOfPlane(buffer, 0);
+        bytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(buffer, 0);
+        width = CVPixelBufferGetWidthOfPlane(buffer, 0);
+        height = CVPixelBufferGetHeightOfPlane(buffer, 0);
+        pixelStride = 1;
+    } else if (CVPixelBufferGetPixelFormatType(buffer) == kCVPixelFormatType_32BGRA) {
+        base = (const uint8_t *)CVPixelBufferGetBaseAddress(buffer) + 1;
+        bytesPerRow = CVPixelBufferGetBytesPerRow(buffer);
+        width = CVPixelBufferGetWidth(buffer);
+        height = CVPixelBufferGetHeight(buffer);
+        pixelStride = 4;
+    } else {
+        CVPixelBufferUnlockBaseAddress(buffer, kCVPixelBufferLock_ReadOnly);
+        return 0;
+    }
+
+    uint64_t sum = 0;
+    uint64_t count = 0;
+    for (size_t y = 0; y < height; y += kSharpnessRowStep) {
+        const uint8_t *row = base + y * bytesPerRow;
+        for (size_t x = 0; x + 1 < width; x += kSharpnessColumnStep) {
+            int difference = (int)row[(x + 1) * pixelStride] - (int)row[x * pixelStride];
+            sum += (uint64_t)(difference * difference);
+            count++;
+        }
+    }
+    CVPixelBufferUnlockBaseAddress(buffer, kCVPixelBufferLock_ReadOnly);
+    return count > 0 ? (double)sum / (double)count : 0;
+}
+
+@interface SSFrameRing () {
+    // Guarded by @synchronized(self)
+    CVPixelBufferPoolRef _pool;
+    NSDictionary *_allocationAttributes;
+    CVPixelBufferRef *_frames;          // NULL for empty slots
+    CFTimeInterval *_timestamps;
+    NSUInteger _nextSlot;
+    size_t _width;
+    size_t _height;
+    OSType _pixelFormat;
+}
+- (BOOL)createPoolForPixelBuffer:(CVPixelBufferRef)pixelBuffer;
+- (void)releaseFramesAndPool;
+@end
+
+@implementation SSFrameRing
+
++ (double)sharpnessOfFrame:(CVPixelBufferRef)frame {
+    return frame ? SSPixelBufferSharpness(frame) : 0;
+}
+
+- (id)initWithCapacity:(NSUInteger)capacity {
+    return [self initWithCapacity:capacity heldFrameCount:1];
+}
+
+- (id)initWithCapacity:(NSUInteger)capacity heldFrameCount:(NSUInteger)heldFrameCount {
+    self = [super init];
+    if (self) {
+        _capacity = MAX(1, capacity);
+        _heldFrameCount = heldFrameCount;
+        _frames = calloc(_capacity, sizeof(*_frames));
+        _timestamps = calloc(_capacity, sizeof(*_timestamps));
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self releaseFramesAndPool];
+    free(_frames);
+    free(_timestamps);
+}
+
+- (void)addPixelBuffer:(CVPixelBufferRef)pixelBuffer attachments:(NSDictionary *)attachments timestamp:(CFTimeInterval)timestamp {
+    if (!pixelBuffer) {
+        return;
+    }
+    @synchronized(self) {
+        if (!_pool || CVPixelBufferGetWidth(pixelBuffer) != _width || CVPixelBufferGetHeight(pixelBuffer) != _height || CVPixelBufferGetPixelFormatType(pixelBuffer) != _pixelFormat) {
+            [self releaseFramesAndPool];
+            if (![self createPoolForPixelBuffer:pixelBuffer]) {
+                return;
+            }
+        }
+
+        // Only replace the oldest frame once there's a buffer for the new one, so a ring whose
+        // buffers are all in use keeps the frames it has rather than draining
+        CVPixelBufferRef copy = NULL;
+        CVReturn result = CVPixelBufferPoolCreatePixelBufferWithAuxAttributes(kCFAllocatorDefault, _pool, (__bridge CFDictionaryRef)_allocationAttributes, &copy);
+        if (result != kCVReturnSuccess) {
+            // Every buffer is in use; skip this frame rather than grow the pool
+            return;
+        }
+        CVPixelBufferRelease(_frames[_nextSlot]);
+        _frames[_nextSlot] = NULL;
+        SSCopyPixelBuffer(pixelBuffer, copy);
+        // Pooled buffers come back with the attachments of the frame they last held
+        CVBufferRemoveAllAttachments(copy);
+        CVBufferPropagateAttachments(pixelBuffer, copy);
+        if (attachments) {
+            CVBufferSetAttachments(copy, (__bridge CFDictionaryRef)attachments, kCVAttachmentMode_ShouldNotPropagate);
+        }
+        _frames[_nextSlot] = copy;
+        _timestamps[_nextSlot] = timestamp;
+        _nextSlot = (_nextSlot + 1) % _capacity;
+    }
+}
+
+- (CVPixelBufferRef)copyFrameNearTime:(CFTimeInterval)time window:(CFTimeInterval)window timestamp:(CFTimeInterval *)timestamp {
+    // Take references to the candidates, then measure them outside the lock so frames
+    // keep arriving meanwhile
+    CVPixelBufferRef *candidates = calloc(_capacity, sizeof(*candidates));
+    CFTimeInterval *candidateTimestamps = calloc(_capacity, sizeof(*candidateTimestamps));
+    NSUInteger candidateCount = 0;
+    @synchronized(self) {
+        for (NSUInteger slot = 0; slot < _capacity; slot++) {
+            if (_frames[slot] && fabs(_timestamps[slot] - time) <= window) {
+                candidates[candidateCount] = CVPixelBufferRetain(_frames[slot]);
+                candidateTimestamps[candidateCount] = _timestamps[slot];
+                candidateCount++;
+            }
+        }
+    }
+
+    CVPixelBufferRef bestFrame = NULL;
+    CFTimeInterval bestTimestamp = 0;
+    double bestSharpness = -1;
+    for (NSUInteger idx = 0; idx < candidateCount; idx++) {
+        double sharpness = (candidateCount > 1) ? SSPixelBufferSharpness(candidates[idx]) : 0;
+        BOOL closer = bestFrame && fabs(candidateTimestamps[idx] - time) < fabs(bestTimestamp - time);
+        if (sharpness > bestSharpness || (sharpness == bestSharpness && closer)) {
+            CVPixelBufferRelease(bestFrame);
+            bestFrame = candidates[idx];
+            bestTimestamp = candidateTimestamps[idx];
+            bestSharpness = sharpness;
+        } else {
+            CVPixelBufferRelease(candidates[idx]);
+        }
+    }
+    free(candidates);
+    free(candidateTimestamps);
+
+    if (bestFrame && timestamp) {
+        *timestamp = bestTimestamp;
+    }
+    return bestFrame;
+}
+
+- (NSUInteger)copyFrames:(CVPixelBufferRef *)frames maximumCount:(NSUInteger)maximumCount nearTime:(CFTimeInterval)time window:(CFTimeInterval)window {
+    NSUInteger count = 0;
+    @synchronized(self) {
+        // Selection sort by distance from `time`; the ring is only a handful of frames
+        BOOL *taken = calloc(_capacity, sizeof(*taken));
+        while (count < maximumCount) {
+            NSUInteger bestSlot = NSNotFound;
+            for (NSUInteger slot = 0; slot < _capacity; slot++) {
+                if (!_frames[slot] || taken[slot] || fabs(_timestamps[slot] - time) > window) {
+                    continue;
+                }
+                if (bestSlot == NSNotFound || fabs(_timestamps[slot] - time) < fabs(_timestamps[bestSlot] - time)) {
+                    bestSlot = slot;
+                }
+            }
+            if (bestSlot == NSNotFound) {
+                break;
+            }
+            taken[bestSlot] = YES;
+            frames[count++] = CVPixelBufferRetain(_frames[bestSlot]);
+        }
+        free(taken);
+    }
+    return count;
+}
+
+- (void)removeAllFrames {
+    @synchronized(self) {
+        [self releaseFramesAndPool];
+    }
+}
+
+#pragma mark - Private methods
+
+- (BOOL)createPoolForPixelBuffer:(CVPixelBufferRef)pixelBuffer {
+    // Must be called while synchronized
+    _width = CVPixelBufferGetWidth(pixelBuffer);
+    _height = CVPixelBufferGetHeight(pixelBuffer);
+    _pixelFormat = CVPixelBufferGetPixelFormatType(pixelBuffer);
+
+    NSDictionary *poolAttributes = @{ (__bridge NSString *)kCVPixelBufferPoolMinimumBufferCountKey: @(_capacity) };
+    NSDictionary *pixelBufferAttributes = @{ (__bridge NSString *)kCVPixelBufferPixelFormatTypeKey: @(_pixelFormat),
+                                             (__bridge NSString *)kCVPixelBufferWidthKey: @(_width),
+                                             (__bridge NSString *)kCVPixelBufferHeightKey: @(_height),
+                                             (__bridge NSString *)kCVPixelBufferIOSurfacePropertiesKey: @{} };
+    CVReturn result = CVPixelBufferPoolCreate(kCFAllocatorDefault, (__bridge CFDictionaryRef)poolAttributes, (__bridge CFDictionaryRef)pixelBufferAttributes, &_pool);
+    if (result != kCVReturnSuccess) {
+        DDLogError(@"Unable to create frame ring pixel buffer pool: %d", result);
+        _pool = NULL;
+        return NO;
+    }
+
+    // One buffer per slot, one for each frame callers may be holding on to after the ring has
+    // moved past it, and one for a new frame before the oldest is let go
+    _allocationAttributes = @{ (__bridge NSString *)kCVPixelBufferPoolAllocationThresholdKey: @(_capacity + _heldFrameCount + 1) };
+
+    // Allocate everything now rather than while frames are streaming in
+    CVPixelBufferRef *buffers = calloc(_capacity, sizeof(*buffers));
+    for (NSUInteger idx = 0; idx < _capacity; idx++) {
+        CVPixelBufferPoolCreatePixelBufferWithAuxAttributes(kCFAllocatorDefault, _pool, (__bridge CFDictionaryRef)_allocationAttributes, &buffers[idx]);
+    }
+    for (NSUInteger idx = 0; idx < _capacity; idx++) {
+        CVPixelBufferRelease(buffers[idx]);
+    }
+    free(buffers);
+    return YES;
+}
+
+- (void)releaseFramesAndPool {
+    // Must be called while synchronized
+    for (NSUInteger slot = 0; slot < _capacity; slot++) {
+        CVPixelBufferRelease(_frames[slot]);
+        _frames[slot] = NULL;
+    }
+    _nextSlot = 0;
+    if (_pool) {
+        CVPixelBufferPoolRelease(_pool);
+        _pool = NULL;
+    }
+}
+
+@end
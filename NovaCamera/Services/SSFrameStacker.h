@@ -0,0 +1,28 @@
+//
+//  SSFrameStacker.h
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreVideo/CoreVideo.h>
+
+/**
+ * Merges a burst of frames of the same scene into one with less noise, for shooting in low light.
+ * The sharpest frame is the reference. Each of the others is aligned to it tile by tile, searching
+ * a coarse-to-fine pyramid so handshake of a dozen or so pixels is found cheaply. Pixels are then
+ * averaged with the reference, weighted by how closely they match it, so anything that moved
+ * between frames is left out rather than ghosted. Tiles are processed in parallel.
+ */
+@interface SSFrameStacker : NSObject
+
+/**
+ * Merge `frames`, an array of `CVPixelBufferRef`s of the same size in a bi-planar 4:2:0 YUV format.
+ * Returns a new pixel buffer, which the caller must release, or NULL if the frames can't be merged.
+ * If `referenceIndex` isn't NULL, it's set to the index of the frame the result is aligned to.
+ */
++ (CVPixelBufferRef)createStackedFrameFromFrames:(NSArray *)frames referenceIndex:(NSUInteger *)referenceIndex CF_RETURNS_RETAINED;
+
+@end
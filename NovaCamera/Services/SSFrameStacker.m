@@ -0,0 +1,303 @@
+//
+//  SSFrameStacker.m
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import "SSFrameStacker.h"
+#import "SSFrameRing.h"
+
+// Frames are aligned in square tiles of this many luma pixels
+static const int kTileSize = 32;
+// Number of alignment pyramid levels, including full resolution; each is half the size of the last
+static const int kPyramidLevels = 3;
+// Search radius at the coarsest level, in that level's pixels; ±16 pixels at full resolution
+static const int kCoarseSearchRadius = 4;
+// Differences from the reference up to kMergeNoiseThreshold are taken to be noise and merged in
+// full; beyond kMergeMotionThreshold, to be motion and left out. In between, the weight falls off.
+static const int kMergeNoiseThreshold = 10;
+static const int kMergeMotionThreshold = 40;
+static const int kMergeFullWeight = 16;
+
+typedef struct {
+    const uint8_t *data;
+    size_t bytesPerRow;
+    int width;
+    int height;
+} SSPlane;
+
+static inline int SSClamp(int value, int minimum, int maximum) {
+    return value < minimum ? minimum : (value > maximum ? maximum : value);
+}
+
+static inline int SSMergeWeight(int difference) {
+    if (difference <= kMergeNoiseThreshold) {
+        return kMergeFullWeight;
+    }
+    if (difference >= kMergeMotionThreshold) {
+        return 0;
+    }
+    return kMergeFullWeight * (kMergeMotionThreshold - difference) / (kMergeMotionThreshold - kMergeNoiseThreshold);
+}
+
+// Halve a plane with a 2x2 box filter, into newly allocated memory the caller must free
+static SSPlane SSDownsamplePlane(const SSPlane *source) {
+    SSPlane result;
+    result.width = source->width / 2;
+    result.height = source->height / 2;
+    result.bytesPerRow = (size_t)result.width;
+    uint8_t *data = malloc(result.bytesPerRow * (size_t)result.height);
+    for (int y = 0; y < result.height; y++) {
+        const uint8_t *row0 = source->data + (size_t)(2 * y) * source->bytesPerRow;
+        const uint8_t *row1 = row0 + source->bytesPerRow;
+        uint8_t *out = data + (size_t)y * result.bytesPerRow;
+        for (int x = 0; x < result.width; x++) {
+            out[x] = (uint8_t)((row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1] + 2) / 4);
+        }
+    }
+    result.data = data;
+    return result;
+}
+
+// Sum of absolute differences between a tile of the reference and the alternate displaced by (dx, dy)
+static uint32_t SSTileDifference(const SSPlane *reference, const SSPlane *alternate, int x0, int y0, int size, int dx, int dy) {
+    int x1 = MIN(x0 + size, reference->width);
+    int y1 = MIN(y0 + size, reference->height);
+    BOOL inside = (x0 + dx >= 0 && y0 + dy >= 0 && x1 + dx <= alternate->width && y1 + dy <= alternate->height);
+    uint32_t sum = 0;
+    for (int y = y0; y < y1; y++) {
+        const uint8_t *referenceRow = reference->data + (size_t)y * reference->bytesPerRow;
+        if (inside) {
+            const uint8_t *alternateRow = alternate->data + (size_t)(y + dy) * alternate->bytesPerRow + dx;
+            for (int x = x0; x < x1; x++) {
+                sum += (uint32_t)abs((int)referenceRow[x] - (int)alternateRow[x]);
+            }
+        } else {
+            const uint8_t *alternateRow = alternate->data + (size_t)SSClamp(y + dy, 0, alternate->height - 1) * alternate->bytesPerRow;
+            for (int x = x0; x < x1; x++) {
+                sum += (uint32_t)abs((int)referenceRow[x] - (int)alternateRow[SSClamp(x + dx, 0, alternate->width - 1)]);
+            }
+        }
+    }
+    return sum;
+}
+
+// Find each tile's displacement from the reference to the alternate, coarsest level first
+static void SSAlignTiles(const SSPlane *referencePyramid, const SSPlane *alternatePyramid, int tilesX, int tilesY, int16_t *offsets) {
+    dispatch_apply((size_t)tilesY, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t ty) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            int dx = 0;
+            int dy = 0;
+            for (int level = kPyramidLevels - 1; level >= 0; level--) {
+                if (level < kPyramidLevels - 1) {
+                    dx *= 2;
+                    dy *= 2;
+                }
+                int size = kTileSize >> level;
+                int x0 = tx * size;
+                int y0 = (int)ty * size;
+                int radius = (level == kPyramidLevels - 1) ? kCoarseSearchRadius : 1;
+
+                // Start from the current estimate, so ties keep it
+                int bestDx = dx;
+                int bestDy = dy;
+                uint32_t bestDifference = SSTileDifference(&referencePyramid[level], &alternatePyramid[level], x0, y0, size, dx, dy);
+                for (int oy = -radius; oy <= radius; oy++) {
+                    for (int ox = -radius; ox <= radius; ox++) {
+                        if (ox == 0 && oy == 0) {
+                            continue;
+                        }
+                        uint32_t difference = SSTileDifference(&referencePyramid[level], &alternatePyramid[level], x0, y0, size, dx + ox, dy + oy);
+                        if (difference < bestDifference) {
+                            bestDifference = difference;
+                            bestDx = dx + ox;
+                            bestDy = dy + oy;
+                        }
+                    }
+                }
+                dx = bestDx;
+                dy = bestDy;
+            }
+            size_t tile = (ty * (size_t)tilesX + (size_t)tx) * 2;
+            offsets[tile] = (int16_t)dx;
+            offsets[tile + 1] = (int16_t)dy;
+        }
+    });
+}
+
+@implementation SSFrameStacker
+
++ (CVPixelBufferRef)createStackedFrameFromFrames:(NSArray *)frames referenceIndex:(NSUInteger *)outReferenceIndex {
+    NSUInteger frameCount = frames.count;
+    if (frameCount == 0) {
+        return NULL;
+    }
+    CVPixelBufferRef firstFrame = (__bridge CVPixelBufferRef)frames[0];
+    if (frameCount == 1) {
+        if (outReferenceIndex) {
+            *outReferenceIndex = 0;
+        }
+        return CVPixelBufferRetain(firstFrame);
+    }
+
+    OSType pixelFormat = CVPixelBufferGetPixelFormatType(firstFrame);
+    int width = (int)CVPixelBufferGetWidth(firstFrame);
+    int height = (int)CVPixelBufferGetHeight(firstFrame);
+    if (pixelFormat != kCVPixelFormatType_420YpCbCr8BiPlanarFullRange && pixelFormat != kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange) {
+        DDLogError(@"Unable to stack frames in pixel format %u", (unsigned int)pixelFormat);
+        return NULL;
+    }
+    if (width < (kTileSize << kPyramidLevels) || height < (kTileSize << kPyramidLevels)) {
+        return NULL;
+    }
+    for (id frame in frames) {
+        CVPixelBufferRef pixelBuffer = (__bridge CVPixelBufferRef)frame;
+        if (CVPixelBufferGetPixelFormatType(pixelBuffer) != pixelFormat || (int)CVPixelBufferGetWidth(pixelBuffer) != width || (int)CVPixelBufferGetHeight(pixelBuffer) != height) {
+            DDLogError(@"Unable to stack frames of differing sizes or formats");
+            return NULL;
+        }
+    }
+
+    // The sharpest frame is the one the others are aligned to and merged into
+    NSUInteger referenceIndex = 0;
+    double referenceSharpness = -1;
+    for (NSUInteger idx = 0; idx < frameCount; idx++) {
+        double sharpness = [SSFrameRing sharpnessOfFrame:(__bridge CVPixelBufferRef)frames[idx]];
+        if (sharpness > referenceSharpness) {
+            referenceSharpness = sharpness;
+            referenceIndex = idx;
+        }
+    }
+    if (outReferenceIndex) {
+        *outReferenceIndex = referenceIndex;
+    }
+
+    NSDictionary *attributes = @{ (__bridge NSString *)kCVPixelBufferIOSurfacePropertiesKey: @{} };
+    CVPixelBufferRef output = NULL;
+    if (CVPixelBufferCreate(kCFAllocatorDefault, (size_t)width, (size_t)height, pixelFormat, (__bridge CFDictionaryRef)attributes, &output) != kCVReturnSuccess) {
+        return NULL;
+    }
+
+    // Luma pyramids and chroma planes for every frame
+    SSPlane *lumaPyramids = calloc(frameCount * kPyramidLevels, sizeof(*lumaPyramids));
+    SSPlane *chromaPlanes = calloc(frameCount, sizeof(*chromaPlanes));
+    for (NSUInteger idx = 0; idx < frameCount; idx++) {
+        CVPixelBufferRef frame = (__bridge CVPixelBufferRef)frames[idx];
+        CVPixelBufferLockBaseAddress(frame, kCVPixelBufferLock_ReadOnly);
+        SSPlane *luma = &lumaPyramids[idx * kPyramidLevels];
+        luma->data = CVPixelBufferGetBaseAddressOfPlane(frame, 0);
+        luma->bytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(frame, 0);
+        luma->width = width;
+        luma->height = height;
+        chromaPlanes[idx].data = CVPixelBufferGetBaseAddressOfPlane(frame, 1);
+        chromaPlanes[idx].bytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(frame, 1);
+        chromaPlanes[idx].width = (int)CVPixelBufferGetWidthOfPlane(frame, 1);
+        chromaPlanes[idx].height = (int)CVPixelBufferGetHeightOfPlane(frame, 1);
+    }
+    dispatch_apply(frameCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t idx) {
+        SSPlane *luma = &lumaPyramids[idx * kPyramidLevels];
+        for (int level = 1; level < kPyramidLevels; level++) {
+            luma[level] = SSDownsamplePlane(&luma[level - 1]);
+        }
+    });
+
+    // Align every frame to the reference; the reference's own offsets stay zero
+    int tilesX = (width + kTileSize - 1) / kTileSize;
+    int tilesY = (height + kTileSize - 1) / kTileSize;
+    size_t offsetsPerFrame = (size_t)tilesX * (size_t)tilesY * 2;
+    int16_t *offsets = calloc(frameCount * offsetsPerFrame, sizeof(*offsets));
+    for (NSUInteger idx = 0; idx < frameCount; idx++) {
+        if (idx != referenceIndex) {
+            SSAlignTiles(&lumaPyramids[referenceIndex * kPyramidLevels], &lumaPyramids[idx * kPyramidLevels], tilesX, tilesY, &offsets[idx * offsetsPerFrame]);
+        }
+    }
+
+    // Merge, a row of tiles at a time
+    CVPixelBufferLockBaseAddress(output, 0);
+    uint8_t *outputLuma = CVPixelBufferGetBaseAddressOfPlane(output, 0);
+    size_t outputLumaBytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(output, 0);
+    uint8_t *outputChroma = CVPixelBufferGetBaseAddressOfPlane(output, 1);
+    size_t outputChromaBytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(output, 1);
+    dispatch_apply((size_t)tilesY, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t ty) {
+        const SSPlane *referenceLuma = &lumaPyramids[referenceIndex * kPyramidLevels];
+        const SSPlane *referenceChroma = &chromaPlanes[referenceIndex];
+        for (int tx = 0; tx < tilesX; tx++) {
+            size_t tile = (ty * (size_t)tilesX + (size_t)tx) * 2;
+            int x0 = tx * kTileSize;
+            int y0 = (int)ty * kTileSize;
+            int x1 = MIN(x0 + kTileSize, width);
+            int y1 = MIN(y0 + kTileSize, height);
+
+            for (int y = y0; y < y1; y++) {
+                const uint8_t *referenceRow = referenceLuma->data + (size_t)y * referenceLuma->bytesPerRow;
+                uint8_t *outputRow = outputLuma + (size_t)y * outputLumaBytesPerRow;
+                for (int x = x0; x < x1; x++) {
+                    int reference = referenceRow[x];
+                    int sum = reference * kMergeFullWeight;
+                    int weightSum = kMergeFullWeight;
+                    for (NSUInteger idx = 0; idx < frameCount; idx++) {
+                        if (idx == referenceIndex) {
+                            continue;
+                        }
+                        const SSPlane *luma = &lumaPyramids[idx * kPyramidLevels];
+                        const int16_t *offset = &offsets[idx * offsetsPerFrame + tile];
+                        int ax = SSClamp(x + offset[0], 0, width - 1);
+                        int ay = SSClamp(y + offset[1], 0, height - 1);
+                        int value = luma->data[(size_t)ay * luma->bytesPerRow + (size_t)ax];
+                        int weight = SSMergeWeight(abs(value - reference));
+                        sum += weight * value;
+                        weightSum += weight;
+                    }
+                    outputRow[x] = (uint8_t)((sum + weightSum / 2) / weightSum);
+                }
+            }
+
+            // Chroma is subsampled 2x2 and interleaved CbCr; it moves with the luma tile
+            int chromaX1 = MIN((x1 + 1) / 2, referenceChroma->width);
+            int chromaY1 = MIN((y1 + 1) / 2, referenceChroma->height);
+            for (int cy = y0 / 2; cy < chromaY1; cy++) {
+                const uint8_t *referenceRow = referenceChroma->data + (size_t)cy * referenceChroma->bytesPerRow;
+                uint8_t *outputRow = outputChroma + (size_t)cy * outputChromaBytesPerRow;
+                for (int cx = x0 / 2; cx < chromaX1; cx++) {
+                    int referenceCb = referenceRow[2 * cx];
+                    int referenceCr = referenceRow[2 * cx + 1];
+                    int sumCb = referenceCb * kMergeFullWeight;
+                    int sumCr = referenceCr * kMergeFullWeight;
+                    int weightSum = kMergeFullWeight;
+                    for (NSUInteger idx = 0; idx < frameCount; idx++) {
+                        if (idx == referenceIndex) {
+                            continue;
+                        }
+                        const SSPlane *chroma = &chromaPlanes[idx];
+                        const int16_t *offset = &offsets[idx * offsetsPerFrame + tile];
+                        int ax = SSClamp(cx + offset[0] / 2, 0, chroma->width - 1);
+                        int ay = SSClamp(cy + offset[1] / 2, 0, chroma->height - 1);
+                        const uint8_t *sample = chroma->data + (size_t)ay * chroma->bytesPerRow + (size_t)(2 * ax);
+                        int weight = SSMergeWeight(MAX(abs(sample[0] - referenceCb), abs(sample[1] - referenceCr)));
+                        sumCb += weight * sample[0];
+                        sumCr += weight * sample[1];
+                        weightSum += weight;
+                    }
+                    outputRow[2 * cx] = (uint8_t)((sumCb + weightSum / 2) / weightSum);
+                    outputRow[2 * cx + 1] = (uint8_t)((sumCr + weightSum / 2) / weightSum);
+                }
+            }
+        }
+    });
+    CVPixelBufferUnlockBaseAddress(output, 0);
+
+    for (NSUInteger idx = 0; idx < frameCount; idx++) {
+        for (int level = 1; level < kPyramidLevels; level++) {
+            free((void *)lumaPyramids[idx * kPyramidLevels + level].data);
+        }
+        CVPixelBufferUnlockBaseAddress((__bridge CVPixelBufferRef)frames[idx], kCVPixelBufferLock_ReadOnly);
+    }
+    free(lumaPyramids);
+    free(chromaPlanes);
+    free(offsets);
+    return output;
+}
+
+@end
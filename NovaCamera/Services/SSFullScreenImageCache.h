@@ -0,0 +1,54 @@
+//
+//  SSFullScreenImageCache.h
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Decoded image cache keyed by asset URL, bounded by the number of bytes held
+ * by the decoded bitmaps. Least recently used images are evicted first; the
+ * pinned image (the page currently on screen) is never evicted.
+ * All methods are thread-safe.
+ */
+@interface SSFullScreenImageCache : NSObject
+
+/**
+ * Maximum number of bytes of decoded images to hold
+ */
+@property (nonatomic, readonly) NSUInteger byteBudget;
+
+/**
+ * Number of bytes of decoded images currently held
+ */
+@property (nonatomic, readonly) NSUInteger currentBytes;
+
+/**
+ * Asset URL of the image that must not be evicted
+ */
+@property (atomic, strong) NSURL *pinnedAssetURL;
+
+/**
+ * Create a cache holding at most `byteBudget` bytes of decoded images
+ */
+- (id)initWithByteBudget:(NSUInteger)byteBudget;
+
+/**
+ * Return the cached image for the given asset URL, or nil. Marks the image as recently used.
+ */
+- (UIImage *)imageForAssetURL:(NSURL *)assetURL;
+
+/**
+ * Add an image to the cache, evicting least recently used images as needed
+ */
+- (void)setImage:(UIImage *)image forAssetURL:(NSURL *)assetURL;
+
+/**
+ * Evict everything except the pinned image
+ */
+- (void)removeAllImages;
+
+@end
@@ -0,0 +1,103 @@
+//
+//  SSFullScreenImageCache.m
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import "SSFullScreenImageCache.h"
+
+@interface SSFullScreenImageCache () {
+    NSMutableDictionary *_imagesByURL;
+    NSMutableArray *_recentlyUsedURLs;     // Least recently used first
+}
++ (NSUInteger)costForImage:(UIImage *)image;
+- (void)evictToBudget;
+@end
+
+@implementation SSFullScreenImageCache
+
+- (id)initWithByteBudget:(NSUInteger)byteBudget {
+    self = [super init];
+    if (self) {
+        _byteBudget = byteBudget;
+        _imagesByURL = [NSMutableDictionary dictionary];
+        _recentlyUsedURLs = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (UIImage *)imageForAssetURL:(NSURL *)assetURL {
+    if (!assetURL) {
+        return nil;
+    }
+    @synchronized(self) {
+        UIImage *image = _imagesByURL[assetURL];
+        if (image) {
+            [_recentlyUsedURLs removeObject:assetURL];
+            [_recentlyUsedURLs addObject:assetURL];
+        }
+        return image;
+    }
+}
+
+- (void)setImage:(UIImage *)image forAssetURL:(NSURL *)assetURL {
+    if (!image || !assetURL) {
+        return;
+    }
+    @synchronized(self) {
+        UIImage *previousImage = _imagesByURL[assetURL];
+        if (previousImage) {
+            _currentBytes -= [[self class] costForImage:previousImage];
+            [_recentlyUsedURLs removeObject:assetURL];
+        }
+        _imagesByURL[assetURL] = image;
+        _currentBytes += [[self class] costForImage:image];
+        [_recentlyUsedURLs addObject:assetURL];
+        [self evictToBudget];
+    }
+}
+
+- (void)removeAllImages {
+    @synchronized(self) {
+        NSURL *pinnedAssetURL = self.pinnedAssetURL;
+        UIImage *pinnedImage = pinnedAssetURL ? _imagesByURL[pinnedAssetURL] : nil;
+        [_imagesByURL removeAllObjects];
+        [_recentlyUsedURLs removeAllObjects];
+        _currentBytes = 0;
+        if (pinnedImage) {
+            _imagesByURL[pinnedAssetURL] = pinnedImage;
+            [_recentlyUsedURLs addObject:pinnedAssetURL];
+            _currentBytes = [[self class] costForImage:pinnedImage];
+        }
+    }
+}
+
+#pragma mark - Private methods
+
++ (NSUInteger)costForImage:(UIImage *)image {
+    CGImageRef cgImage = image.CGImage;
+    if (!cgImage) {
+        return 0;
+    }
+    return CGImageGetBytesPerRow(cgImage) * CGImageGetHeight(cgImage);
+}
+
+- (void)evictToBudget {
+    // Caller must hold the lock
+    NSURL *pinnedAssetURL = self.pinnedAssetURL;
+    NSUInteger idx = 0;
+    while (_currentBytes > _byteBudget && idx < _recentlyUsedURLs.count) {
+        NSURL *url = _recentlyUsedURLs[idx];
+        if ([url isEqual:pinnedAssetURL]) {
+            idx++;
+            continue;
+        }
+        _currentBytes -= [[self class] costForImage:_imagesByURL[url]];
+        [_imagesByURL removeObjectForKey:url];
+        [_recentlyUsedURLs removeObjectAtIndex:idx];
+    }
+}
+
+@end
@@ -0,0 +1,80 @@
+//
+//  SSImageJobScheduler.h
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Priority classes for image work, most urgent first
+ */
+typedef enum {
+    SSImageJobPriorityVisible = 0,      // Something the user is waiting to see
+    SSImageJobPriorityPrefetch,         // Likely to be needed soon
+    SSImageJobPriorityIndexing,         // Background bookkeeping
+} SSImageJobPriority;
+
+/**
+ * A unit of work submitted to `SSImageJobScheduler`; doubles as its cancellation token
+ */
+@interface SSImageJob : NSObject
+
+/**
+ * Current priority. Raising the priority of a job that's still waiting moves it ahead in line.
+ */
+@property (atomic, assign) SSImageJobPriority priority;
+
+/**
+ * Estimated number of bytes the job holds while it runs
+ */
+@property (nonatomic, readonly) NSUInteger cost;
+
+/**
+ * Whether the job has been cancelled
+ */
+@property (atomic, readonly, getter=isCancelled) BOOL cancelled;
+
+/**
+ * Cancel the job. If it hasn't started, it never will; a job that's already running can
+ * check `isCancelled` to stop early.
+ */
+- (void)cancel;
+
+@end
+
+/**
+ * Runs image decoding and processing jobs in priority order, with a cap on the number running
+ * at once and on the memory they hold between them, so a burst of requests (e.g. a fast swipe
+ * through the library) can't queue up a dozen full resolution decodes at the same time.
+ * Jobs run on the global queues, so idle threads pick up whatever work is admitted next.
+ */
+@interface SSImageJobScheduler : NSObject
+
+/**
+ * Singleton accessor
+ */
++ (id)sharedService;
+
+/**
+ * Maximum number of bytes held by running jobs. A job costing more than this still runs,
+ * but only on its own.
+ */
+@property (atomic, assign) NSUInteger byteBudget;
+
+/**
+ * Maximum number of jobs running at once
+ */
+@property (atomic, assign) NSUInteger maxConcurrentJobs;
+
+/**
+ * Schedule a job. `block` is called on a background queue once the job is admitted, unless it
+ * has been cancelled first.
+ *
+ * @param cost Estimated number of bytes held while the job runs, e.g. the size of a decoded bitmap
+ */
+- (SSImageJob *)scheduleJobWithPriority:(SSImageJobPriority)priority cost:(NSUInteger)cost block:(void (^)(SSImageJob *job))block;
+
+@end
@@ -0,0 +1,141 @@
+//
+//  SSImageJobScheduler.m
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import "SSImageJobScheduler.h"
+
+// Enough for one full resolution decode plus a filtered copy, alongside a few full screen images
+static const NSUInteger kDefaultByteBudget = 96 * 1024 * 1024;
+
+@interface SSImageJob ()
+@property (atomic, readwrite, getter=isCancelled) BOOL cancelled;
+@property (nonatomic, readwrite) NSUInteger cost;
+@property (nonatomic, copy) void (^block)(SSImageJob *job);
+@property (nonatomic, assign) uint64_t sequence;
+@end
+
+@implementation SSImageJob
+
+- (void)cancel {
+    self.cancelled = YES;
+}
+
+@end
+
+@interface SSImageJobScheduler () {
+    // Must be accessed on _queue
+    NSMutableArray *_pendingJobs;
+    NSUInteger _runningJobCount;
+    NSUInteger _runningBytes;
+    uint64_t _nextSequence;
+}
+@property (nonatomic, strong) dispatch_queue_t queue;
+- (SSImageJob *)nextAdmissibleJob;
+- (void)runPendingJobs;
+- (void)finishJob:(SSImageJob *)job;
+@end
+
+@implementation SSImageJobScheduler
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        self.queue = dispatch_queue_create("image job scheduler queue", DISPATCH_QUEUE_SERIAL);
+        self.byteBudget = kDefaultByteBudget;
+        self.maxConcurrentJobs = MAX(2, [[NSProcessInfo processInfo] activeProcessorCount]);
+        _pendingJobs = [NSMutableArray array];
+    }
+    return self;
+}
+
++ (id)sharedService {
+    static id _sharedService;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        _sharedService = [[self alloc] init];
+    });
+    return _sharedService;
+}
+
+- (SSImageJob *)scheduleJobWithPriority:(SSImageJobPriority)priority cost:(NSUInteger)cost block:(void (^)(SSImageJob *job))block {
+    SSImageJob *job = [[SSImageJob alloc] init];
+    job.priority = priority;
+    job.cost = cost;
+    job.block = block;
+    dispatch_async(self.queue, ^{
+        job.sequence = _nextSequence++;
+        [_pendingJobs addObject:job];
+        [self runPendingJobs];
+    });
+    return job;
+}
+
+#pragma mark - Private methods
+
+- (SSImageJob *)nextAdmissibleJob {
+    // Must be called on queue
+    // Highest priority first, then oldest first. Priorities can change while jobs wait,
+    // so pick by scanning rather than keeping the list sorted; it's never long.
+    SSImageJob *nextJob = nil;
+    for (SSImageJob *job in [_pendingJobs copy]) {
+        if (job.isCancelled) {
+            [_pendingJobs removeObject:job];
+            continue;
+        }
+        if (!nextJob || job.priority < nextJob.priority || (job.priority == nextJob.priority && job.sequence < nextJob.sequence)) {
+            nextJob = job;
+        }
+    }
+    if (!nextJob || _runningJobCount >= self.maxConcurrentJobs) {
+        return nil;
+    }
+    // Don't let cheaper, less urgent jobs overtake one that's waiting for memory
+    if (_runningJobCount > 0 && _runningBytes + nextJob.cost > self.byteBudget) {
+        return nil;
+    }
+    return nextJob;
+}
+
+- (void)runPendingJobs {
+    // Must be called on queue
+    SSImageJob *job;
+    while ((job = [self nextAdmissibleJob])) {
+        [_pendingJobs removeObject:job];
+        _runningJobCount++;
+        _runningBytes += job.cost;
+
+        long queuePriority;
+        switch (job.priority) {
+            case SSImageJobPriorityVisible:
+                queuePriority = DISPATCH_QUEUE_PRIORITY_HIGH;
+                break;
+            case SSImageJobPriorityPrefetch:
+                queuePriority = DISPATCH_QUEUE_PRIORITY_DEFAULT;
+                break;
+            default:
+                queuePriority = DISPATCH_QUEUE_PRIORITY_BACKGROUND;
+                break;
+        }
+        dispatch_async(dispatch_get_global_queue(queuePriority, 0), ^{
+            if (!job.isCancelled) {
+                job.block(job);
+            }
+            [self finishJob:job];
+        });
+    }
+}
+
+- (void)finishJob:(SSImageJob *)job {
+    dispatch_async(self.queue, ^{
+        job.block = nil;
+        _runningJobCount--;
+        _runningBytes -= job.cost;
+        [self runPendingJobs];
+    });
+}
+
+@end
@@ -34,6 +34,18 @@ typedef struct {
 
 NSString * SSFlashSettingsDescribe(SSFlashSettings settings);
 
+/**
+ * Describe flash settings for the EXIF UserComment of a photo taken with them, and parse
+ * such a comment back. Parsing returns NO if the comment wasn't written by SSFlashSettingsUserComment.
+ */
+NSString * SSFlashSettingsUserComment(SSFlashSettings settings);
+BOOL SSFlashSettingsFromUserComment(NSString *userComment, SSFlashSettings *settings);
+
+/**
+ * The drive levels, 0-255, sent to the warm and cool LEDs for flash settings. Both are 0 when off.
+ */
+void SSFlashSettingsGetLEDLevels(SSFlashSettings settings, uint8_t *warm, uint8_t *cool);
+
 /**
  * Predefined flash settings
  */
@@ -54,6 +66,15 @@ typedef enum {
     SSNovaFlashStatusUnknown = -1,
 } SSNovaFlashStatus;
 
+/**
+ * How many units of a flash group must confirm they are lit before the shutter is released
+ */
+typedef enum {
+    SSFlashQuorumFirst = 0,     // The first unit to respond
+    SSFlashQuorumAll,           // Every responsive unit
+    SSFlashQuorumCount,         // `flashQuorumCount` units
+} SSFlashQuorumPolicy;
+
 /**
  * Notifications
  */
@@ -78,6 +99,12 @@ static const NSString *SSNovaFlashServiceStatusChanged;
  */
 @property (nonatomic, assign) SSFlashSettings flashSettings;
 
+/**
+ * The settings the flash was last fired with by `beginFlashWithCallback:`, pre-armed or not,
+ * after any `autoBrightnessEnabled` scaling. Read it from that callback to describe the shot.
+ */
+@property (nonatomic, readonly) SSFlashSettings firedFlashSettings;
+
 /**
  * SSNovaFlashStatus describing the status of the flash unit (or units).
  */
@@ -89,6 +116,35 @@ static const NSString *SSNovaFlashServiceStatusChanged;
  */
 @property (nonatomic, assign) BOOL useMultipleNovas;
 
+/**
+ * Flag determining whether shots scale the flash down to what the scene needs, as metered from
+ * preview frames by `SSPreviewMeter`, keeping the chosen mix of warm and cool. Needs the capture
+ * session's metering enabled.
+ */
+@property (nonatomic, assign) BOOL autoBrightnessEnabled;
+
+/**
+ * Policy deciding when a multi-unit flash is considered lit (default SSFlashQuorumAll).
+ * Units that are chronically slow to respond are still fired, but are not waited for.
+ */
+@property (nonatomic, assign) SSFlashQuorumPolicy flashQuorumPolicy;
+
+/**
+ * Number of units required when `flashQuorumPolicy` is SSFlashQuorumCount
+ */
+@property (nonatomic, assign) NSUInteger flashQuorumCount;
+
+/**
+ * How long to wait for units to confirm they are lit before releasing the shutter anyway
+ */
+@property (nonatomic, assign) NSTimeInterval flashUnitDeadline;
+
+/**
+ * Recent begin flash latency for each unit, keyed by flash identifier. Each value is a
+ * dictionary with "median" and "p95" latencies in seconds, the "samples" count and a "slow" flag.
+ */
+@property (nonatomic, readonly) NSDictionary *flashLatencyStatistics;
+
 /**
  * Singleton accessor
  */
@@ -130,7 +186,8 @@ static const NSString *SSNovaFlashServiceStatusChanged;
 - (void)endTemporaryEnableFlash;
 
 /**
- * Perform actual flash with specific settings
+ * Perform actual flash with specific settings. All connected units are fired at once and
+ * `callback` is called when `flashQuorumPolicy` is satisfied or `flashUnitDeadline` passes.
  */
 - (void)beginFlashWithSettings:(SSFlashSettings)flashSettings callback:(void (^)(BOOL status))callback;
 
@@ -140,7 +197,20 @@ static const NSString *SSNovaFlashServiceStatusChanged;
 - (void)beginFlashWithCallback:(void (^)(BOOL status))callback;
 
 /**
- * End flash; send when image is captured
+ * Speculatively begin the flash because a capture looks imminent, hiding the BLE round trip
+ * from shutter lag. A following `beginFlashWithCallback:` claims the pre-armed flash; if none
+ * arrives shortly, the flash is turned off again. Call from the main thread.
+ */
+- (void)prearmFlash;
+
+/**
+ * Cancel a pre-armed flash that hasn't been claimed by `beginFlashWithCallback:`
+ */
+- (void)cancelPrearm;
+
+/**
+ * End flash; send when image is captured. `callback` is called once every unit has confirmed it
+ * is off, or `flashUnitDeadline` passes, so a flash begun from it will find all units ready.
  */
 - (void)endFlashWithCallback:(void (^)(BOOL status))callback;
 
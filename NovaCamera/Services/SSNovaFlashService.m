@@ -7,7 +7,9 @@
 //
 
 #import "SSNovaFlashService.h"
+#import "SSPreviewMeter.h"
 #import "SSSettingsService.h"
+#import "SSTraceService.h"
 #import <NovaSDK/NVFlashService.h>
 
 static const NSString *SSNovaFlashServiceStatusChanged = @"SSNovaFlashServiceStatusChanged";
@@ -18,6 +20,31 @@ static const uint16_t kFlashTimeout = 20000;
 
 static const int kMaxPairedNovas = 10;
 
+// Lowest non-zero level an LED is driven at, to protect the current
+static const uint8_t kMinimumLEDLevel = 64;
+// Preview frames metered this soon after the flash went off may still show it lit (or the camera
+// recovering from it), so automatic brightness reuses the last shot's level meanwhile
+static const CFTimeInterval kFlashMeteringRecoveryTime = 1.0;
+
+// Default time to wait for flash units to confirm they are lit
+static const NSTimeInterval kDefaultFlashUnitDeadline = 0.5;
+// Number of recent begin flash latencies kept for each unit
+static const NSUInteger kFlashLatencySampleCount = 16;
+// Samples needed before a unit can be judged slow
+static const NSUInteger kFlashLatencyMinimumSamples = 4;
+// Consecutive missed deadlines after which a unit is judged slow
+static const NSUInteger kFlashMaxConsecutiveMisses = 3;
+// Rapid settings changes (e.g. dragging the warm/cool sliders) are saved once they've paused for this long
+static const NSTimeInterval kSaveFlashSettingsDelay = 0.5;
+// How long a pre-armed flash stays lit waiting for a capture before being turned off
+static const NSTimeInterval kPrearmTimeout = 2.0;
+
+typedef enum {
+    SSFlashPrearmNone = 0,
+    SSFlashPrearmArming,    // Begin flash sent, waiting for the units to respond
+    SSFlashPrearmArmed,     // Lit and waiting to be claimed
+} SSFlashPrearmState;
+
 NSString * SSFlashSettingsDescribe(SSFlashSettings settings) {
     switch (settings.flashMode) {
         case SSFlashModeOff:
@@ -37,15 +64,155 @@ NSString * SSFlashSettingsDescribe(SSFlashSettings settings) {
     }
 }
 
+NSString * SSFlashSettingsUserComment(SSFlashSettings settings) {
+    return [NSString stringWithFormat:@"Nova flash: mode=%d warm=%.3f cool=%.3f", settings.flashMode, settings.warmBrightness, settings.coolBrightness];
+}
+
+BOOL SSFlashSettingsFromUserComment(NSString *userComment, SSFlashSettings *settings) {
+    int flashMode;
+    double warm, cool;
+    if (sscanf([userComment UTF8String], "Nova flash: mode=%d warm=%lf cool=%lf", &flashMode, &warm, &cool) != 3) {
+        return NO;
+    }
+    if (settings) {
+        settings->flashMode = (SSFlashMode)flashMode;
+        settings->warmBrightness = warm;
+        settings->coolBrightness = cool;
+    }
+    return YES;
+}
+
+void SSFlashSettingsGetLEDLevels(SSFlashSettings settings, uint8_t *warm, uint8_t *cool) {
+    switch (settings.flashMode) {
+        default:
+            DDLogError(@"Unknown flash mode %d", settings.flashMode);
+        case SSFlashModeOff:
+            *warm = 0;
+            *cool = 0;
+            break;
+        case SSFlashModeBright:
+            *warm = 255;
+            *cool = 255;
+            break;
+        case SSFlashModeGentle:
+            *warm = 31;
+            *cool = 31;
+            break;
+        case SSFlashModeWarm:
+            *warm = 255;
+            *cool = 127;
+            break;
+        case SSFlashModeNeutral:
+            *warm = 0;
+            *cool = 255;
+            break;
+        case SSFlashModeCustom:
+            // Scale down according to brightness setting, converting to 8bit
+            *warm = (uint8_t)(settings.warmBrightness * 255.0);
+            *cool = (uint8_t)(settings.coolBrightness * 255.0);
+            
+            // Protect current: TODO, move this into NovaSDK when more stable
+            if (*warm > 0 && *warm < kMinimumLEDLevel) {
+                *warm = kMinimumLEDLevel;
+            }
+            if (*cool > 0 && *cool < kMinimumLEDLevel) {
+                *cool = kMinimumLEDLevel;
+            }
+            break;
+    }
+}
+
+/**
+ * Rolling record of one flash unit's begin flash latencies
+ */
+@interface SSFlashUnitStatistics : NSObject {
+    NSTimeInterval _samples[kFlashLatencySampleCount];
+}
+@property (nonatomic, readonly) NSUInteger sampleCount;
+@property (nonatomic, readonly) NSUInteger consecutiveMisses;
+- (void)recordLatency:(NSTimeInterval)latency deadline:(NSTimeInterval)deadline;
+- (void)recordMissedDeadline;
+- (NSTimeInterval)latencyAtPercentile:(double)percentile;
+- (BOOL)isSlowForDeadline:(NSTimeInterval)deadline;
+@end
+
+@implementation SSFlashUnitStatistics
+
+- (void)recordLatency:(NSTimeInterval)latency deadline:(NSTimeInterval)deadline {
+    _samples[_sampleCount % kFlashLatencySampleCount] = latency;
+    _sampleCount++;
+    if (latency <= deadline) {
+        _consecutiveMisses = 0;
+    }
+}
+
+- (void)recordMissedDeadline {
+    _consecutiveMisses++;
+}
+
+- (NSTimeInterval)latencyAtPercentile:(double)percentile {
+    NSUInteger count = MIN(_sampleCount, kFlashLatencySampleCount);
+    if (count == 0) {
+        return 0;
+    }
+    NSTimeInterval sorted[kFlashLatencySampleCount];
+    memcpy(sorted, _samples, sizeof(NSTimeInterval) * count);
+    // Tiny array; insertion sort
+    for (NSUInteger i = 1; i < count; i++) {
+        NSTimeInterval value = sorted[i];
+        NSUInteger j = i;
+        while (j > 0 && sorted[j - 1] > value) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = value;
+    }
+    NSUInteger index = (NSUInteger)(percentile * (count - 1) + 0.5);
+    return sorted[MIN(index, count - 1)];
+}
+
+- (BOOL)isSlowForDeadline:(NSTimeInterval)deadline {
+    if (_consecutiveMisses >= kFlashMaxConsecutiveMisses) {
+        return YES;
+    }
+    return (_sampleCount >= kFlashLatencyMinimumSamples && [self latencyAtPercentile:0.5] > deadline);
+}
+
+@end
+
 @interface SSNovaFlashService () {
     BOOL _temporarilyEnabled;
+    NSMutableDictionary *_flashUnitStatistics;
+    
+    // Last enable/disable command sent to the SDK, so repeated ones can be skipped
+    BOOL _flashEnableCommandSent;
+    BOOL _flashEnabled;
+    
+    // Debounced save of flash settings
+    NSUInteger _saveGeneration;
+    
+    // Pre-arm state; main thread only
+    SSFlashPrearmState _prearmState;
+    BOOL _prearmStatus;
+    SSFlashSettings _prearmSettings;
+    BOOL _prearmClaimed;
+    NSUInteger _prearmGeneration;
+    CFTimeInterval _prearmStartTime;
+    CFTimeInterval _prearmArmedTime;
+    NSMutableArray *_prearmCallbacks;
+    NSUInteger _wastedPrearmCount;
+    CFTimeInterval _lastFlashEndTime;
+    double _lastAutoBrightnessFraction;
 }
 + (SSNovaFlashStatus)novaFlashStatusForNVFlashServiceStatus:(NVFlashService*)nvFlashService;
 + (NVFlashSettings *)nvFlashSettingsForNovaFlashSettings:(SSFlashSettings)settings;
 - (void)setupFlash;
 - (void)teardownFlash;
 - (void)saveToUserDefaults;
+- (void)scheduleSaveToUserDefaults;
 - (void)restoreFromUserDefaults;
+- (SSFlashUnitStatistics *)statisticsForFlash:(id<NVFlash>)flash;
+- (SSFlashSettings)flashSettingsForShot;
 @end
 
 @implementation SSNovaFlashService
@@ -54,6 +221,13 @@ NSString * SSFlashSettingsDescribe(SSFlashSettings settings) {
     self = [super init];
     if (self) {
         _temporarilyEnabled = NO;
+        _flashUnitStatistics = [NSMutableDictionary dictionary];
+        _prearmState = SSFlashPrearmNone;
+        _prearmCallbacks = [NSMutableArray array];
+        _lastAutoBrightnessFraction = 1.0;
+        self.flashQuorumPolicy = SSFlashQuorumAll;
+        self.flashQuorumCount = 1;
+        self.flashUnitDeadline = kDefaultFlashUnitDeadline;
 
         // Load previous values from NSUserDefaults
         [self restoreFromUserDefaults];
@@ -85,14 +259,24 @@ NSString * SSFlashSettingsDescribe(SSFlashSettings settings) {
         self.nvFlashService.autoPairMode = NVAutoPairClosest;
     }*/
     
-    if (self.flashSettings.flashMode == SSFlashModeOff) {
-        [self disableFlash];
-    } else {
+    // Settings changes arrive in bursts while sliders are dragged, but only a change between
+    // off and on needs a command sent to the flash
+    BOOL enable = (self.flashSettings.flashMode != SSFlashModeOff);
+    if (_flashEnableCommandSent && _flashEnabled == enable
+        && (self.status == SSNovaFlashStatusDisabled) == !enable) {
+        return;
+    }
+    
+    if (enable) {
         [self enableFlash];
+    } else {
+        [self disableFlash];
     }
 }
 
 - (void)enableFlash {
+    _flashEnableCommandSent = YES;
+    _flashEnabled = YES;
     [self.nvFlashService enable];
 }
 
@@ -104,6 +288,8 @@ NSString * SSFlashSettingsDescribe(SSFlashSettings settings) {
 }
 
 - (void)disableFlash {
+    _flashEnableCommandSent = YES;
+    _flashEnabled = NO;
     [self.nvFlashService disable];
 }
 
@@ -128,75 +314,295 @@ NSString * SSFlashSettingsDescribe(SSFlashSettings settings) {
 - (void)beginFlashWithSettings:(SSFlashSettings)flashSettings callback:(void (^)(BOOL status))callback {
     NVFlashSettings *nvFlashSettings = [[self class] nvFlashSettingsForNovaFlashSettings:flashSettings];
     NSArray *flashes = self.nvFlashService.connectedFlashes;
-    __block BOOL firstResponseReceived = NO;
-    int attempted = 0;
+    NSTimeInterval deadline = self.flashUnitDeadline;
+    
+    // Fire every unit that isn't already lit, but only wait for the ones that have been keeping up
+    NSMutableArray *unitsToFire = [NSMutableArray array];
+    NSMutableSet *criticalUnits = [NSMutableSet set];
     for (id<NVFlash> flash in flashes) {
-        DDLogVerbose(@"Calling nvFlashService beginFlash with settings %@ on %@", nvFlashSettings, flash.identifier);
-        
         if (flash.lit) {
             continue;
         }
-        
-        attempted++;
+        [unitsToFire addObject:flash];
+        SSFlashUnitStatistics *statistics = [self statisticsForFlash:flash];
+        BOOL slow;
+        @synchronized(statistics) {
+            slow = [statistics isSlowForDeadline:deadline];
+        }
+        if (!slow) {
+            [criticalUnits addObject:flash.identifier];
+        } else {
+            DDLogVerbose(@"Flash %@ has been slow to respond; not waiting for it", flash.identifier);
+        }
+    }
+    if (unitsToFire.count == 0) {
+        if (callback) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                callback(NO);
+            });
+        }
+        return;
+    }
+    if (criticalUnits.count == 0) {
+        // Everything is slow; better to wait for all of them than none
+        for (id<NVFlash> flash in unitsToFire) {
+            [criticalUnits addObject:flash.identifier];
+        }
+    }
+    
+    NSUInteger required;
+    switch (self.flashQuorumPolicy) {
+        case SSFlashQuorumFirst:
+            required = 1;
+            break;
+        case SSFlashQuorumCount:
+            required = MAX(1, MIN(self.flashQuorumCount, criticalUnits.count));
+            break;
+        case SSFlashQuorumAll:
+        default:
+            required = criticalUnits.count;
+            break;
+    }
+    
+    CFTimeInterval startTime = CACurrentMediaTime();
+    
+    // Shared state for this request; all access is synchronized on `pending`
+    NSMutableSet *pending = [NSMutableSet set];
+    for (id<NVFlash> flash in unitsToFire) {
+        [pending addObject:flash.identifier];
+    }
+    __block NSUInteger criticalResponses = 0;
+    __block NSUInteger criticalSuccesses = 0;
+    __block BOOL resolved = NO;
+    void (^resolve)(BOOL status) = ^(BOOL status) {
+        // Must be called while synchronized on `pending`
+        if (resolved) {
+            return;
+        }
+        resolved = YES;
+        [[SSTraceService sharedService] recordSpan:@"flash.quorum" startTime:startTime endTime:CACurrentMediaTime()];
+        if (callback) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                callback(status);
+            });
+        }
+    };
+    
+    for (id<NVFlash> flash in unitsToFire) {
+        DDLogVerbose(@"Calling nvFlashService beginFlash with settings %@ on %@", nvFlashSettings, flash.identifier);
+        id identifier = flash.identifier;
+        BOOL critical = [criticalUnits containsObject:identifier];
         [flash beginFlash:nvFlashSettings withCallback:^(BOOL status) {
-            DDLogVerbose(@"NVFlashService beginFlash:withCallback: callback fired with status %d on %@", status, flash.identifier);
-            if (callback) {
-                if (!firstResponseReceived) {
-                    firstResponseReceived = YES;
-                    dispatch_async(dispatch_get_main_queue(), ^{
-                        callback(status);
-                    });
+            CFTimeInterval responseTime = CACurrentMediaTime();
+            NSTimeInterval latency = responseTime - startTime;
+            [[SSTraceService sharedService] recordSpan:@"flash.unit" startTime:startTime endTime:responseTime];
+            DDLogVerbose(@"NVFlashService beginFlash:withCallback: callback fired with status %d on %@ after %.0f ms", status, identifier, latency * 1000.0);
+            SSFlashUnitStatistics *statistics = [self statisticsForFlash:flash];
+            @synchronized(statistics) {
+                [statistics recordLatency:latency deadline:deadline];
+            }
+            
+            @synchronized(pending) {
+                [pending removeObject:identifier];
+                if (!critical) {
+                    return;
+                }
+                criticalResponses++;
+                if (status) {
+                    criticalSuccesses++;
+                }
+                if (criticalSuccesses >= required) {
+                    resolve(YES);
+                } else if (criticalResponses == criticalUnits.count) {
+                    // Everyone we were waiting for has answered; settle for what we have
+                    resolve(criticalSuccesses > 0);
                 }
             }
         }];
-        
     }
-    if (attempted == 0) {
+    
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(deadline * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        @synchronized(pending) {
+            for (id<NVFlash> flash in unitsToFire) {
+                if ([pending containsObject:flash.identifier]) {
+                    DDLogVerbose(@"Flash %@ missed its %.0f ms deadline", flash.identifier, deadline * 1000.0);
+                    SSFlashUnitStatistics *statistics = [self statisticsForFlash:flash];
+                    @synchronized(statistics) {
+                        [statistics recordMissedDeadline];
+                    }
+                }
+            }
+            if (!resolved) {
+                DDLogVerbose(@"Flash quorum not reached before deadline (%lu of %lu lit)", (unsigned long)criticalSuccesses, (unsigned long)required);
+            }
+            resolve(criticalSuccesses > 0);
+        }
+    });
+}
+
+- (void)beginFlashWithCallback:(void (^)(BOOL))callback {
+    if (_prearmState == SSFlashPrearmArming) {
+        DDLogVerbose(@"Claiming pre-arm in progress; saved %.0f ms", (CACurrentMediaTime() - _prearmStartTime) * 1000.0);
+        _prearmClaimed = YES;
+        _firedFlashSettings = _prearmSettings;
+        if (callback) {
+            [_prearmCallbacks addObject:[callback copy]];
+        }
+        return;
+    }
+    if (_prearmState == SSFlashPrearmArmed) {
+        DDLogVerbose(@"Claiming pre-armed flash; saved %.0f ms", (_prearmArmedTime - _prearmStartTime) * 1000.0);
+        _prearmState = SSFlashPrearmNone;
+        _prearmGeneration++;
+        _firedFlashSettings = _prearmSettings;
+        BOOL status = _prearmStatus;
         if (callback) {
             dispatch_async(dispatch_get_main_queue(), ^{
-                callback(NO);
+                callback(status);
             });
         }
+        return;
     }
+    _firedFlashSettings = [self flashSettingsForShot];
+    return [self beginFlashWithSettings:_firedFlashSettings callback:callback];
 }
 
-- (void)beginFlashWithCallback:(void (^)(BOOL))callback {
-    return [self beginFlashWithSettings:self.flashSettings callback:callback];
+- (void)prearmFlash {
+    if (self.flashSettings.flashMode == SSFlashModeOff || _prearmState != SSFlashPrearmNone) {
+        return;
+    }
+    DDLogVerbose(@"Pre-arming flash");
+    _prearmState = SSFlashPrearmArming;
+    _prearmClaimed = NO;
+    _prearmStartTime = CACurrentMediaTime();
+    NSUInteger generation = ++_prearmGeneration;
+    _prearmSettings = [self flashSettingsForShot];
+    
+    [self beginFlashWithSettings:_prearmSettings callback:^(BOOL status) {
+        if (generation != _prearmGeneration) {
+            // Cancelled while arming
+            return;
+        }
+        _prearmArmedTime = CACurrentMediaTime();
+        if (_prearmClaimed) {
+            _prearmState = SSFlashPrearmNone;
+            _prearmGeneration++;
+            NSArray *callbacks = [_prearmCallbacks copy];
+            [_prearmCallbacks removeAllObjects];
+            for (void (^callback)(BOOL) in callbacks) {
+                callback(status);
+            }
+        } else {
+            _prearmState = SSFlashPrearmArmed;
+            _prearmStatus = status;
+        }
+    }];
+    
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kPrearmTimeout * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        if (generation == _prearmGeneration && !_prearmClaimed) {
+            DDLogVerbose(@"Pre-armed flash expired");
+            [self cancelPrearm];
+        }
+    });
+}
+
+- (void)cancelPrearm {
+    if (_prearmState == SSFlashPrearmNone || _prearmClaimed) {
+        return;
+    }
+    _prearmState = SSFlashPrearmNone;
+    _prearmGeneration++;
+    _wastedPrearmCount++;
+    DDLogVerbose(@"Cancelling pre-armed flash (%lu wasted so far)", (unsigned long)_wastedPrearmCount);
+    [self endFlashWithCallback:nil];
 }
 
 - (void)endFlashWithCallback:(void (^)(BOOL status))callback {
+    _lastFlashEndTime = CACurrentMediaTime();
     NSArray *flashes = self.nvFlashService.connectedFlashes;
     if (flashes.count == 0) {
         if (callback) {
             dispatch_async(dispatch_get_main_queue(), ^{
                 callback(NO);
             });
-       }
+        }
+        return;
+    }
+    
+    // Call back once every unit has gone out, since a begin flash sent before then would skip
+    // the units still lit. Units that don't answer within the deadline aren't waited for.
+    NSTimeInterval deadline = self.flashUnitDeadline;
+    NSMutableSet *pending = [NSMutableSet set];
+    for (id<NVFlash> flash in flashes) {
+        [pending addObject:flash.identifier];
     }
-    __block BOOL firstResponseReceived = NO;
+    __block BOOL anySucceeded = NO;
+    __block BOOL resolved = NO;
+    void (^resolve)() = ^{
+        // Must be called while synchronized on `pending`
+        if (resolved) {
+            return;
+        }
+        resolved = YES;
+        if (callback) {
+            BOOL status = anySucceeded;
+            dispatch_async(dispatch_get_main_queue(), ^{
+                callback(status);
+            });
+        }
+    };
+    
     for (id<NVFlash> flash in flashes) {
+        id identifier = flash.identifier;
         [flash endFlashWithCallback:^(BOOL status) {
-            DDLogVerbose(@"NVFlashService endFlashWithCallback: callback fired with status %d on %@", status, flash.identifier);
-            if (callback) {
-                if (!firstResponseReceived) {
-                    firstResponseReceived = YES;
-                    dispatch_async(dispatch_get_main_queue(), ^{
-                        callback(status);
-                    });
+            DDLogVerbose(@"NVFlashService endFlashWithCallback: callback fired with status %d on %@", status, identifier);
+            @synchronized(pending) {
+                [pending removeObject:identifier];
+                if (status) {
+                    anySucceeded = YES;
+                }
+                if (pending.count == 0) {
+                    resolve();
                 }
             }
         }];
     }
+    
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(deadline * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        @synchronized(pending) {
+            if (!resolved) {
+                DDLogVerbose(@"%lu flash units did not confirm end of flash within %.0f ms", (unsigned long)pending.count, deadline * 1000.0);
+            }
+            resolve();
+        }
+    });
 }
 
 #pragma - Properties
 
+- (NSDictionary *)flashLatencyStatistics {
+    NSMutableDictionary *result = [NSMutableDictionary dictionary];
+    @synchronized(_flashUnitStatistics) {
+        [_flashUnitStatistics enumerateKeysAndObjectsUsingBlock:^(id identifier, SSFlashUnitStatistics *statistics, BOOL *stop) {
+            @synchronized(statistics) {
+                result[identifier] = @{ @"median": @([statistics latencyAtPercentile:0.5]),
+                                        @"p95": @([statistics latencyAtPercentile:0.95]),
+                                        @"samples": @(statistics.sampleCount),
+                                        @"slow": @([statistics isSlowForDeadline:self.flashUnitDeadline]) };
+            }
+        }];
+    }
+    return result;
+}
+
 - (void)setFlashSettings:(SSFlashSettings)flashSettings {
     // Don't allow setting custom flash mode
     [self willChangeValueForKey:@"flashSettings"];
     _flashSettings = flashSettings;
+    // Any pre-armed flash was lit with the old settings
+    [self cancelPrearm];
     [self configureFlash];
-    [self saveToUserDefaults];
+    [self scheduleSaveToUserDefaults];
     [self didChangeValueForKey:@"flashSettings"];
 }
 
@@ -227,50 +633,42 @@ NSString * SSFlashSettingsDescribe(SSFlashSettings settings) {
 }
 
 + (NVFlashSettings *)nvFlashSettingsForNovaFlashSettings:(SSFlashSettings)settings {
+    uint8_t warm, cool;
+    SSFlashSettingsGetLEDLevels(settings, &warm, &cool);
     NVFlashSettings *nvFlashSettings;
-    switch (settings.flashMode) {
-        default:
-            DDLogError(@"Unknown flash mode %d", settings.flashMode);
-        case SSFlashModeOff:
-            nvFlashSettings = [NVFlashSettings off];
-            break;
-        case SSFlashModeBright:
-            nvFlashSettings = [NVFlashSettings customWarm:255 cool:255];
-            break;
-        case SSFlashModeGentle:
-            nvFlashSettings = [NVFlashSettings customWarm:31 cool:31];
-            break;
-        case SSFlashModeWarm:
-            nvFlashSettings = [NVFlashSettings customWarm:255 cool:127];
-            break;
-        case SSFlashModeNeutral:
-            nvFlashSettings = [NVFlashSettings customWarm:0 cool:255];
-            break;
-        case SSFlashModeCustom:
-        {
-            // Scale down according to brightness setting(
-            double pctWarm = settings.warmBrightness;
-            double pctCool = settings.coolBrightness;
-            
-            // Convert to 8bit
-            uint8_t warm = (uint8_t)(pctWarm * 255.0);
-            uint8_t cool = (uint8_t)(pctCool * 255.0);
-            
-            // Protect current: TODO, move this into NovaSDK when more stable
-            if (warm > 0 && warm < 64) {
-                warm = 64;
-            }
-            if (cool > 0 && cool < 64) {
-                cool = 64;
-            }
-            
-            nvFlashSettings = [NVFlashSettings customWarm:warm cool:cool];
-            break;
-        }
+    if (warm == 0 && cool == 0) {
+        nvFlashSettings = [NVFlashSettings off];
+    } else {
+        nvFlashSettings = [NVFlashSettings customWarm:warm cool:cool];
     }
     return [nvFlashSettings flashSettingsWithTimeout:kFlashTimeout];
 }
 
+- (SSFlashSettings)flashSettingsForShot {
+    SSFlashSettings settings = self.flashSettings;
+    if (!self.autoBrightnessEnabled || settings.flashMode == SSFlashModeOff) {
+        return settings;
+    }
+    uint8_t warm, cool;
+    SSFlashSettingsGetLEDLevels(settings, &warm, &cool);
+    if (warm == 0 && cool == 0) {
+        return settings;
+    }
+    // Scale both LEDs alike to keep the mix, but not so far that the dimmer one would be clamped
+    // back up to the minimum level, which would shift it
+    uint8_t dimmest = (warm && cool) ? MIN(warm, cool) : MAX(warm, cool);
+    if (_lastFlashEndTime == 0 || CACurrentMediaTime() - _lastFlashEndTime > kFlashMeteringRecoveryTime) {
+        _lastAutoBrightnessFraction = [[SSPreviewMeter sharedService] flashOutputFraction];
+    }
+    double fraction = MAX(_lastAutoBrightnessFraction, (double)kMinimumLEDLevel / dimmest);
+    if (fraction >= 1.0) {
+        return settings;
+    }
+    DDLogVerbose(@"Metered scene needs %.0f%% flash", fraction * 100.0);
+    SSFlashSettings scaledSettings = { SSFlashModeCustom, warm * fraction / 255.0, cool * fraction / 255.0 };
+    return scaledSettings;
+}
+
 - (void)setupFlash {
     // Initialize NVFlashService
     self.nvFlashService = [NVFlashService new];
@@ -291,13 +689,31 @@ NSString * SSFlashSettingsDescribe(SSFlashSettings settings) {
     [defaults setInteger:self.flashSettings.flashMode forKey:[kLastFlashSettingsUserDefaultsPrefix stringByAppendingString:@"mode"]];
     [defaults setFloat:self.flashSettings.warmBrightness forKey:[kLastFlashSettingsUserDefaultsPrefix stringByAppendingString:@"warmBrightness"]];
     [defaults setFloat:self.flashSettings.coolBrightness forKey:[kLastFlashSettingsUserDefaultsPrefix stringByAppendingString:@"coolBrightness"]];
-    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
-        [defaults synchronize];
-    });
+    [[SSSettingsService sharedService] scheduleSynchronize];
     DDLogVerbose(@"Wrote flash settings to user defaults");
     DDLogVerbose(@"warm: %g cool: %g", _flashSettings.warmBrightness, _flashSettings.coolBrightness);
 }
 
+- (SSFlashUnitStatistics *)statisticsForFlash:(id<NVFlash>)flash {
+    @synchronized(_flashUnitStatistics) {
+        SSFlashUnitStatistics *statistics = _flashUnitStatistics[flash.identifier];
+        if (!statistics) {
+            statistics = [[SSFlashUnitStatistics alloc] init];
+            _flashUnitStatistics[flash.identifier] = statistics;
+        }
+        return statistics;
+    }
+}
+
+- (void)scheduleSaveToUserDefaults {
+    NSUInteger generation = ++_saveGeneration;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kSaveFlashSettingsDelay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        if (generation == _saveGeneration) {
+            [self saveToUserDefaults];
+        }
+    });
+}
+
 - (void)restoreFromUserDefaults {
     [self willChangeValueForKey:@"flashSettings"];
     _flashSettings = SSFlashSettingsWarm;
@@ -0,0 +1,64 @@
+//
+//  SSPreviewMeter.h
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreVideo/CoreVideo.h>
+
+/**
+ * A measurement of the scene from preview frames
+ */
+typedef struct {
+    // Scene brightness reported by the camera, in APEX brightness value (Bv) stops
+    double sceneBrightness;
+    // Estimated brightness of the subject under the spot, in Bv stops: the scene brightness corrected
+    // for how much brighter or darker the spot is than the frame's median
+    double subjectBrightness;
+    // Luma, 0-255, of the frame's median and the centre/spot weighted mean
+    double medianLuma;
+    double spotLuma;
+    // Fraction of the frame that's clipped to white
+    double highlightFraction;
+    // When the most recent frame contributing to this was taken, from `CACurrentMediaTime()`
+    CFTimeInterval timestamp;
+} SSPreviewMetering;
+
+/**
+ * Meters the scene from the luma of preview frames, for choosing how much flash to use before a
+ * shot. Each frame is sampled on a coarse grid, well under a millisecond's work, into a luma
+ * histogram and a mean weighted towards the centre and a spot, normally where exposure is locked.
+ * Measurements are smoothed over a few frames so one odd frame doesn't swing the result.
+ */
+@interface SSPreviewMeter : NSObject
+
++ (id)sharedService;
+
+/**
+ * Meter a frame in a bi-planar YUV format. `spotPoint` is in the frame's normalised coordinates,
+ * (0, 0) top left to (1, 1) bottom right; `brightnessValue` is the camera's EXIF brightness value
+ * for the frame. May be called from any thread, though frames should arrive in order.
+ */
+- (void)meterFrame:(CVPixelBufferRef)frame spotPoint:(CGPoint)spotPoint brightnessValue:(double)brightnessValue timestamp:(CFTimeInterval)timestamp;
+
+/**
+ * Get the latest measurement. Returns NO if there's none from the last `maximumAge` seconds.
+ */
+- (BOOL)getMetering:(SSPreviewMetering *)metering maximumAge:(CFTimeInterval)maximumAge;
+
+/**
+ * Fraction, 0-1, of full flash output needed to light the metered subject: all of it in the dark,
+ * halving for every stop brighter it already is, and cut further when much of the frame is already
+ * clipped. Returns 1 if there's no recent measurement.
+ */
+- (double)flashOutputFraction;
+
+/**
+ * Discard measurements, e.g. when switching cameras
+ */
+- (void)reset;
+
+@end
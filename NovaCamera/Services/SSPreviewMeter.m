@@ -0,0 +1,165 @@
+//
+//  SSPreviewMeter.m
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import "SSPreviewMeter.h"
+
+// Frames are sampled on a grid this many samples wide, about 2,300 samples for a 16:9 frame
+static const size_t kMeterGridColumns = 64;
+static const size_t kMeterGridMaxRows = 256;
+// Spreads of the centre and spot weightings, as fractions of the frame, and the spot's weight
+// relative to the centre's
+static const float kCentreSigma = 0.35f;
+static const float kSpotSigma = 0.08f;
+static const float kSpotWeight = 4.0f;
+// Luma at or above which a sample counts as clipped
+static const int kHighlightLuma = 250;
+// Gamma of the luma encoding, for turning luma ratios into stops
+static const double kLumaGamma = 2.2;
+// Measurements are smoothed with this time constant; after a longer gap, smoothing starts over
+static const CFTimeInterval kSmoothingTimeConstant = 0.25;
+static const CFTimeInterval kSmoothingMaximumGap = 1.0;
+// Subjects at or below this brightness, in Bv stops, need the full flash
+static const double kFullFlashSubjectBrightness = 0.0;
+// Once more than this fraction of the frame is clipped, the flash is cut a stop for every further
+// `kHighlightFractionPerStop`, so a subject that's already bright isn't blown out
+static const double kHighlightFractionTolerance = 0.02;
+static const double kHighlightFractionPerStop = 0.05;
+// Measurements older than this aren't used to set the flash
+static const CFTimeInterval kFlashMeteringMaximumAge = 0.5;
+
+@interface SSPreviewMeter () {
+    // Must be accessed while synchronized
+    SSPreviewMetering _metering;
+    BOOL _hasMetering;
+}
+@end
+
+@implementation SSPreviewMeter
+
++ (id)sharedService {
+    static id _sharedService;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        _sharedService = [[self alloc] init];
+    });
+    return _sharedService;
+}
+
+- (void)meterFrame:(CVPixelBufferRef)frame spotPoint:(CGPoint)spotPoint brightnessValue:(double)brightnessValue timestamp:(CFTimeInterval)timestamp {
+    if (!CVPixelBufferIsPlanar(frame)) {
+        return;
+    }
+    CVPixelBufferLockBaseAddress(frame, kCVPixelBufferLock_ReadOnly);
+    const uint8_t *luma = CVPixelBufferGetBaseAddressOfPlane(frame, 0);
+    size_t bytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(frame, 0);
+    size_t width = CVPixelBufferGetWidthOfPlane(frame, 0);
+    size_t height = CVPixelBufferGetHeightOfPlane(frame, 0);
+    // Round the step up so the grid is never wider than the weighting tables
+    size_t step = MAX((size_t)1, (width + kMeterGridColumns - 1) / kMeterGridColumns);
+    size_t columns = MIN(width / step, kMeterGridColumns);
+    size_t rows = MIN(height / step, kMeterGridMaxRows);
+    // When the row cap applies, spread the rows over the whole height rather than just the top
+    size_t rowStep = rows ? height / rows : step;
+    if (!luma || columns == 0 || rows == 0) {
+        CVPixelBufferUnlockBaseAddress(frame, kCVPixelBufferLock_ReadOnly);
+        return;
+    }
+
+    // The weightings are separable, so work them out per column and per row
+    float centreX[kMeterGridColumns], spotX[kMeterGridColumns];
+    float centreY[kMeterGridMaxRows], spotY[kMeterGridMaxRows];
+    for (size_t i = 0; i < columns; i++) {
+        float x = ((float)i + 0.5f) / (float)columns;
+        centreX[i] = expf(-(x - 0.5f) * (x - 0.5f) / (2.0f * kCentreSigma * kCentreSigma));
+        spotX[i] = expf(-(x - (float)spotPoint.x) * (x - (float)spotPoint.x) / (2.0f * kSpotSigma * kSpotSigma));
+    }
+    for (size_t j = 0; j < rows; j++) {
+        float y = ((float)j + 0.5f) / (float)rows;
+        centreY[j] = expf(-(y - 0.5f) * (y - 0.5f) / (2.0f * kCentreSigma * kCentreSigma));
+        spotY[j] = expf(-(y - (float)spotPoint.y) * (y - (float)spotPoint.y) / (2.0f * kSpotSigma * kSpotSigma));
+    }
+
+    uint32_t histogram[256] = { 0 };
+    float weightedSum = 0;
+    float weightSum = 0;
+    for (size_t j = 0; j < rows; j++) {
+        const uint8_t *row = luma + (j * rowStep + rowStep / 2) * bytesPerRow + step / 2;
+        for (size_t i = 0; i < columns; i++) {
+            uint8_t value = row[i * step];
+            histogram[value]++;
+            float weight = centreX[i] * centreY[j] + kSpotWeight * spotX[i] * spotY[j];
+            weightedSum += weight * value;
+            weightSum += weight;
+        }
+    }
+    CVPixelBufferUnlockBaseAddress(frame, kCVPixelBufferLock_ReadOnly);
+
+    uint32_t sampleCount = (uint32_t)(rows * columns);
+    uint32_t cumulative = 0;
+    int median = 0;
+    while (median < 255 && (cumulative += histogram[median]) < sampleCount / 2) {
+        median++;
+    }
+    uint32_t highlights = 0;
+    for (int value = kHighlightLuma; value < 256; value++) {
+        highlights += histogram[value];
+    }
+
+    SSPreviewMetering metering;
+    metering.sceneBrightness = brightnessValue;
+    metering.medianLuma = median;
+    metering.spotLuma = weightedSum / weightSum;
+    metering.subjectBrightness = brightnessValue + kLumaGamma * log2((metering.spotLuma + 1.0) / (metering.medianLuma + 1.0));
+    metering.highlightFraction = (double)highlights / (double)sampleCount;
+    metering.timestamp = timestamp;
+
+    @synchronized(self) {
+        CFTimeInterval elapsed = timestamp - _metering.timestamp;
+        if (!_hasMetering || elapsed <= 0 || elapsed > kSmoothingMaximumGap) {
+            _metering = metering;
+            _hasMetering = YES;
+        } else {
+            double alpha = 1.0 - exp(-elapsed / kSmoothingTimeConstant);
+            _metering.sceneBrightness += alpha * (metering.sceneBrightness - _metering.sceneBrightness);
+            _metering.subjectBrightness += alpha * (metering.subjectBrightness - _metering.subjectBrightness);
+            _metering.medianLuma += alpha * (metering.medianLuma - _metering.medianLuma);
+            _metering.spotLuma += alpha * (metering.spotLuma - _metering.spotLuma);
+            _metering.highlightFraction += alpha * (metering.highlightFraction - _metering.highlightFraction);
+            _metering.timestamp = timestamp;
+        }
+    }
+}
+
+- (BOOL)getMetering:(SSPreviewMetering *)metering maximumAge:(CFTimeInterval)maximumAge {
+    @synchronized(self) {
+        if (!_hasMetering || CACurrentMediaTime() - _metering.timestamp > maximumAge) {
+            return NO;
+        }
+        if (metering) {
+            *metering = _metering;
+        }
+        return YES;
+    }
+}
+
+- (double)flashOutputFraction {
+    SSPreviewMetering metering;
+    if (![self getMetering:&metering maximumAge:kFlashMeteringMaximumAge]) {
+        return 1.0;
+    }
+    double highlightStops = MAX(0.0, metering.highlightFraction - kHighlightFractionTolerance) / kHighlightFractionPerStop;
+    return MIN(1.0, pow(2.0, kFullFlashSubjectBrightness - metering.subjectBrightness - highlightStops));
+}
+
+- (void)reset {
+    @synchronized(self) {
+        _hasMetering = NO;
+    }
+}
+
+@end
@@ -20,6 +20,11 @@ extern NSString *kSettingsServiceOptOutStatsKey;
 extern NSString *kSettingsServiceEnableVolumeButtonTriggerKey;
 extern NSString *kSettingsServiceLightBoostKey;
 extern NSString *kSettingsServiceResetFocusOnSceneChangeKey;
+extern NSString *kSettingsServiceZeroShutterLagKey;
+extern NSString *kSettingsServiceFlashFusionKey;
+extern NSString *kSettingsServiceFlashColorCorrectionKey;
+extern NSString *kSettingsServiceAutoFlashBrightnessKey;
+extern NSString *kSettingsServiceLowLightStackingKey;
 extern NSString *kSettingsServiceMultipleNovasKey;
 
 // Private settings that are never shown to user
@@ -74,8 +79,15 @@ extern NSString *kSettingsServiceOneTimeAskedOptOutQuestion;
 - (BOOL)boolForKey:(NSString *)key;
 
 /**
- * Set the value for the given key
+ * Set the value for the given key. The value is available immediately; writing it to disk
+ * is deferred and coalesced with other changes.
  */
 - (void)setBool:(BOOL)value forKey:(NSString *)key;
 
+/**
+ * Write NSUserDefaults to disk shortly, coalescing with any other pending request.
+ * Use this after changing NSUserDefaults directly rather than calling `synchronize`.
+ */
+- (void)scheduleSynchronize;
+
 @end
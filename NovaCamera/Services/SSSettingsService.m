@@ -18,20 +18,45 @@ const NSString *kSettingsServiceEnableVolumeButtonTriggerKey = @"SettingsService
 const NSString *kSettingsServiceLightBoostKey = @"SettingsServiceLightBoostKey";
 const NSString *kSettingsServiceResetFocusOnSceneChangeKey = @"SettingsServiceResetFocusOnSceneChangeKey";
 const NSString *kSettingsServiceMultipleNovasKey = @"SettingsServiceMultipleNovasKey";
+const NSString *kSettingsServiceZeroShutterLagKey = @"SettingsServiceZeroShutterLagKey";
+const NSString *kSettingsServiceFlashFusionKey = @"SettingsServiceFlashFusionKey";
+const NSString *kSettingsServiceFlashColorCorrectionKey = @"SettingsServiceFlashColorCorrectionKey";
+const NSString *kSettingsServiceAutoFlashBrightnessKey = @"SettingsServiceAutoFlashBrightnessKey";
+const NSString *kSettingsServiceLowLightStackingKey = @"SettingsServiceLowLightStackingKey";
 
 
 // Private settings that are never shown to user
 const NSString *kSettingsServiceOneTimeAskedOptOutQuestion = @"SettingsServiceOneTimeAskedOptOutQuestion";
 
+// Settings changes are written to disk together, this long after the first of them
+static const NSTimeInterval kSynchronizeDelay = 1.0;
+
+@interface SSSettingsService () {
+    // Cache of boolean values, so hot paths don't go through NSUserDefaults
+    NSMutableDictionary *_boolCache;
+    dispatch_queue_t _synchronizeQueue;
+    BOOL _synchronizeScheduled;     // Only accessed on _synchronizeQueue
+}
+- (void)synchronizeNow;
+- (void)applicationDidEnterBackground:(NSNotification *)notification;
+@end
+
 @implementation SSSettingsService
 
 - (id)init {
     self = [super init];
     if (self) {
+        _boolCache = [NSMutableDictionary dictionary];
+        _synchronizeQueue = dispatch_queue_create("settings synchronize queue", DISPATCH_QUEUE_SERIAL);
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(applicationDidEnterBackground:) name:UIApplicationDidEnterBackgroundNotification object:nil];
     }
     return self;
 }
 
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
 + (id)sharedService {
     static id _sharedService;
     static dispatch_once_t once;
@@ -53,6 +78,11 @@ const NSString *kSettingsServiceOneTimeAskedOptOutQuestion = @"SettingsServiceOn
                           @YES,     // kSettingsServiceLightBoostKey
                           @YES,     // kSettingsServiceResetFocusOnSceneChangeKey
                           @NO,      // kSettingsServiceMultipleNovasKey
+                          @NO,      // kSettingsServiceZeroShutterLagKey
+                          @NO,      // kSettingsServiceFlashFusionKey
+                          @NO,      // kSettingsServiceFlashColorCorrectionKey
+                          @NO,      // kSettingsServiceAutoFlashBrightnessKey
+                          @NO,      // kSettingsServiceLowLightStackingKey
                           ];
     NSUserDefaults *userDefaults = [NSUserDefaults standardUserDefaults];
     NSArray *keys = [self generalSettingsKeys];
@@ -64,7 +94,10 @@ const NSString *kSettingsServiceOneTimeAskedOptOutQuestion = @"SettingsServiceOn
             [userDefaults setBool:val forKey:key];
         }
     }
-    [userDefaults synchronize];
+    @synchronized(_boolCache) {
+        [_boolCache removeAllObjects];
+    }
+    [self scheduleSynchronize];
 }
 
 - (NSArray *)generalSettingsKeys {
@@ -77,6 +110,11 @@ const NSString *kSettingsServiceOneTimeAskedOptOutQuestion = @"SettingsServiceOn
              kSettingsServiceLightBoostKey,
              kSettingsServiceResetFocusOnSceneChangeKey,
              kSettingsServiceMultipleNovasKey,
+             kSettingsServiceZeroShutterLagKey,
+             kSettingsServiceFlashFusionKey,
+             kSettingsServiceFlashColorCorrectionKey,
+             kSettingsServiceAutoFlashBrightnessKey,
+             kSettingsServiceLowLightStackingKey,
              ];
 }
 
@@ -90,6 +128,11 @@ const NSString *kSettingsServiceOneTimeAskedOptOutQuestion = @"SettingsServiceOn
              @"Night vision in low light",
              @"Scene change resets focus",
              @"Multiple Novas",
+             @"Instant shutter without flash",
+             @"Keep ambient light with flash",
+             @"Color-correct flash photos",
+             @"Automatic flash brightness",
+             @"Merge frames in low light",
              ];
 }
 
@@ -108,19 +151,59 @@ const NSString *kSettingsServiceOneTimeAskedOptOutQuestion = @"SettingsServiceOn
 
 - (void)clearKey:(NSString *)key {
     [[NSUserDefaults standardUserDefaults] removeObjectForKey:key];
+    @synchronized(_boolCache) {
+        [_boolCache removeObjectForKey:key];
+    }
+    [self scheduleSynchronize];
 }
 
 - (BOOL)boolForKey:(NSString *)key {
-    return [[NSUserDefaults standardUserDefaults] boolForKey:key];
+    @synchronized(_boolCache) {
+        NSNumber *value = _boolCache[key];
+        if (!value) {
+            value = @([[NSUserDefaults standardUserDefaults] boolForKey:key]);
+            _boolCache[key] = value;
+        }
+        return [value boolValue];
+    }
 }
 
 - (void)setBool:(BOOL)value forKey:(NSString *)key {
     [self willChangeValueForKey:key];
+    @synchronized(_boolCache) {
+        _boolCache[key] = @(value);
+    }
     [[NSUserDefaults standardUserDefaults] setBool:value forKey:key];
     [self didChangeValueForKey:key];
-    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
-        [[NSUserDefaults standardUserDefaults] synchronize];
-        [self didChangeValueForKey:key];
+    [self scheduleSynchronize];
+}
+
+- (void)scheduleSynchronize {
+    dispatch_async(_synchronizeQueue, ^{
+        if (_synchronizeScheduled) {
+            return;
+        }
+        _synchronizeScheduled = YES;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kSynchronizeDelay * NSEC_PER_SEC)), _synchronizeQueue, ^{
+            [self synchronizeNow];
+        });
+    });
+}
+
+#pragma mark - Private methods
+
+- (void)synchronizeNow {
+    // Must be called on _synchronizeQueue
+    _synchronizeScheduled = NO;
+    [[NSUserDefaults standardUserDefaults] synchronize];
+}
+
+- (void)applicationDidEnterBackground:(NSNotification *)notification {
+    // We may be suspended or killed at any point from here on; write pending changes now
+    UIBackgroundTaskIdentifier taskIdentifier = [[UIApplication sharedApplication] beginBackgroundTaskWithExpirationHandler:nil];
+    dispatch_async(_synchronizeQueue, ^{
+        [self synchronizeNow];
+        [[UIApplication sharedApplication] endBackgroundTask:taskIdentifier];
     });
 }
 
@@ -10,8 +10,46 @@
 #import "SSSettingsService.h"
 #import <Mixpanel/Mixpanel.h>
 
+static void * OptOutStatsChangedContext = &OptOutStatsChangedContext;
+
+// Events are held for this long and then delivered to Mixpanel together, keeping analytics
+// work off the main thread while photos are being taken
+static const NSTimeInterval kStatsBatchDelay = 2.0;
+
+@interface SSStatsService () {
+    // Cached copy of the opt-out setting, so reporting doesn't need to consult NSUserDefaults
+    volatile BOOL _optedOut;
+    dispatch_queue_t _eventQueue;
+    NSMutableArray *_pendingEvents;  // Only accessed on _eventQueue
+    BOOL _flushScheduled;            // Only accessed on _eventQueue
+}
+- (void)enqueueEvent:(NSString *)eventName properties:(NSDictionary *)properties;
+- (void)flush;
+- (void)applicationDidEnterBackground:(NSNotification *)notification;
+@end
+
 @implementation SSStatsService
 
+- (id)init {
+    self = [super init];
+    if (self) {
+        _eventQueue = dispatch_queue_create("stats event queue", DISPATCH_QUEUE_SERIAL);
+        _pendingEvents = [NSMutableArray array];
+        
+        SSSettingsService *settingsService = [SSSettingsService sharedService];
+        _optedOut = [settingsService boolForKey:kSettingsServiceOptOutStatsKey];
+        [settingsService addObserver:self forKeyPath:kSettingsServiceOptOutStatsKey options:0 context:OptOutStatsChangedContext];
+        
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(applicationDidEnterBackground:) name:UIApplicationDidEnterBackgroundNotification object:nil];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [[SSSettingsService sharedService] removeObserver:self forKeyPath:kSettingsServiceOptOutStatsKey context:OptOutStatsChangedContext];
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
 + (id)sharedService {
     static id _sharedService;
     static dispatch_once_t once;
@@ -27,29 +65,83 @@
 }
 
 - (void)report: (NSString *)eventName {
-    if ([[SSSettingsService sharedService] boolForKey:kSettingsServiceOptOutStatsKey]) {
+    if (_optedOut) {
         return;
     }
     
     DDLogVerbose(@"Stat reported: %@", eventName);
-    dispatch_async(dispatch_get_main_queue(), ^{
-        Mixpanel *mixpanel = [Mixpanel sharedInstance];
-        [mixpanel track:eventName];
-        [mixpanel.people increment:eventName by:[NSNumber numberWithInt:1]];
-    });
+    [self enqueueEvent:eventName properties:nil];
 }
 
 - (void)report: (NSString *)eventName properties:(NSDictionary *)properties {
-    if ([[SSSettingsService sharedService] boolForKey:kSettingsServiceOptOutStatsKey]) {
+    if (_optedOut) {
         return;
     }
     
     DDLogVerbose(@"Stat reported: %@ %@", eventName, properties);
+    [self enqueueEvent:eventName properties:properties];
+}
+
+#pragma mark - Private methods
+
+- (void)enqueueEvent:(NSString *)eventName properties:(NSDictionary *)properties {
+    NSDictionary *event = properties ? @{ @"name": eventName, @"properties": [properties copy] } : @{ @"name": eventName };
+    dispatch_async(_eventQueue, ^{
+        [_pendingEvents addObject:event];
+        if (!_flushScheduled) {
+            _flushScheduled = YES;
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kStatsBatchDelay * NSEC_PER_SEC)), _eventQueue, ^{
+                [self flush];
+            });
+        }
+    });
+}
+
+- (void)flush {
+    // Must be called on _eventQueue
+    _flushScheduled = NO;
+    if (_pendingEvents.count == 0) {
+        return;
+    }
+    NSArray *events = [_pendingEvents copy];
+    [_pendingEvents removeAllObjects];
+    if (_optedOut) {
+        return;
+    }
+    
     dispatch_async(dispatch_get_main_queue(), ^{
         Mixpanel *mixpanel = [Mixpanel sharedInstance];
-        [mixpanel track:eventName properties:properties];
-        [mixpanel.people increment:eventName by:[NSNumber numberWithInt:1]];
+        for (NSDictionary *event in events) {
+            NSString *eventName = event[@"name"];
+            NSDictionary *properties = event[@"properties"];
+            if (properties) {
+                [mixpanel track:eventName properties:properties];
+            } else {
+                [mixpanel track:eventName];
+            }
+            [mixpanel.people increment:eventName by:[NSNumber numberWithInt:1]];
+        }
     });
 }
 
+- (void)applicationDidEnterBackground:(NSNotification *)notification {
+    // Hand everything to Mixpanel while we still can
+    dispatch_async(_eventQueue, ^{
+        [self flush];
+    });
+}
+
+#pragma mark - KVO
+
+- (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context {
+    if (context == OptOutStatsChangedContext) {
+        _optedOut = [[SSSettingsService sharedService] boolForKey:kSettingsServiceOptOutStatsKey];
+        if (_optedOut) {
+            dispatch_async(_eventQueue, ^{
+                [_pendingEvents removeAllObjects];
+            });
+        }
+    }
+}
+
 @end
@@ -0,0 +1,68 @@
+//
+//  SSTraceService.h
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * An open span, returned by `beginSpan:` and passed back to `endSpan:`. May be ended on a
+ * different thread from the one that began it.
+ */
+typedef struct {
+    uint32_t nameIndex;
+    CFTimeInterval startTime;
+} SSTraceSpan;
+
+/**
+ * Records named, timestamped spans (e.g. the stages of taking a photo) into a fixed-size ring,
+ * for export as Chrome trace-event JSON (load into chrome://tracing) or as latency percentiles.
+ * Enabled by default in DEBUG builds; when disabled, recording does nothing.
+ */
+@interface SSTraceService : NSObject
+
+/**
+ * Singleton accessor
+ */
++ (id)sharedService;
+
+/**
+ * Whether spans are recorded
+ */
+@property (nonatomic, assign) BOOL enabled;
+
+/**
+ * Begin a span now
+ */
+- (SSTraceSpan)beginSpan:(NSString *)name;
+
+/**
+ * End a span now and record it
+ */
+- (void)endSpan:(SSTraceSpan)span;
+
+/**
+ * Record a span from timestamps already taken with `CACurrentMediaTime()`
+ */
+- (void)recordSpan:(NSString *)name startTime:(CFTimeInterval)startTime endTime:(CFTimeInterval)endTime;
+
+/**
+ * Recorded spans in Chrome trace-event JSON format
+ */
+- (NSData *)chromeTraceData;
+
+/**
+ * Latency summary keyed by span name. Each value is a dictionary with "count" and "p50", "p95"
+ * and "p99" durations in seconds.
+ */
+- (NSDictionary *)summary;
+
+/**
+ * Discard all recorded spans
+ */
+- (void)reset;
+
+@end
@@ -0,0 +1,212 @@
+//
+//  SSTraceService.m
+//  NovaCamera
+//
+//  Created by Sneaky Squid on 10/17/26.
+//  Copyright (c) 2026 Sneaky Squid. All rights reserved.
+//
+
+#import "SSTraceService.h"
+#import <QuartzCore/QuartzCore.h>
+#import <pthread.h>
+
+// Number of spans kept; older spans are overwritten
+static const NSUInteger kTraceCapacity = 4096;
+// Name index of spans begun while tracing was disabled
+static const uint32_t kTraceNoName = UINT32_MAX;
+
+typedef struct {
+    uint32_t nameIndex;
+    uint32_t threadID;
+    CFTimeInterval startTime;
+    CFTimeInterval endTime;
+} SSTraceRecord;
+
+@interface SSTraceService () {
+    pthread_mutex_t _lock;
+    SSTraceRecord *_records;
+    NSUInteger _recordCount;    // Total ever recorded; the ring holds the last kTraceCapacity
+    NSMutableArray *_names;
+    NSMutableDictionary *_nameIndexes;
+}
+- (uint32_t)indexForName:(NSString *)name;
+- (void)appendRecord:(SSTraceRecord)record;
+- (NSArray *)snapshotRecordsWithNames:(NSArray **)names;
+- (void)applicationDidEnterBackground:(NSNotification *)notification;
+@end
+
+@implementation SSTraceService
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        pthread_mutex_init(&_lock, NULL);
+        _records = calloc(kTraceCapacity, sizeof(SSTraceRecord));
+        _names = [NSMutableArray array];
+        _nameIndexes = [NSMutableDictionary dictionary];
+#ifdef DEBUG
+        _enabled = YES;
+#else
+        _enabled = NO;
+#endif
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(applicationDidEnterBackground:) name:UIApplicationDidEnterBackgroundNotification object:nil];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    free(_records);
+    pthread_mutex_destroy(&_lock);
+}
+
++ (id)sharedService {
+    static id _sharedService;
+    static dispatch_once_t once;
+    
+    dispatch_once(&once, ^{
+        _sharedService = [[self alloc] init];
+    });
+    
+    return _sharedService;
+}
+
+#pragma mark - Public methods
+
+- (SSTraceSpan)beginSpan:(NSString *)name {
+    SSTraceSpan span;
+    span.nameIndex = self.enabled ? [self indexForName:name] : kTraceNoName;
+    span.startTime = CACurrentMediaTime();
+    return span;
+}
+
+- (void)endSpan:(SSTraceSpan)span {
+    if (!self.enabled || span.nameIndex == kTraceNoName) {
+        return;
+    }
+    SSTraceRecord record;
+    record.nameIndex = span.nameIndex;
+    record.threadID = pthread_mach_thread_np(pthread_self());
+    record.startTime = span.startTime;
+    record.endTime = CACurrentMediaTime();
+    [self appendRecord:record];
+}
+
+- (void)recordSpan:(NSString *)name startTime:(CFTimeInterval)startTime endTime:(CFTimeInterval)endTime {
+    if (!self.enabled) {
+        return;
+    }
+    SSTraceRecord record;
+    record.nameIndex = [self indexForName:name];
+    record.threadID = pthread_mach_thread_np(pthread_self());
+    record.startTime = startTime;
+    record.endTime = endTime;
+    [self appendRecord:record];
+}
+
+- (NSData *)chromeTraceData {
+    NSArray *names = nil;
+    NSArray *records = [self snapshotRecordsWithNames:&names];
+    
+    NSMutableArray *events = [NSMutableArray arrayWithCapacity:records.count];
+    for (NSValue *value in records) {
+        SSTraceRecord record;
+        [value getValue:&record];
+        // Complete ("X") events, timestamps in microseconds
+        [events addObject:@{ @"name": names[record.nameIndex],
+                             @"ph": @"X",
+                             @"ts": @(record.startTime * 1e6),
+                             @"dur": @((record.endTime - record.startTime) * 1e6),
+                             @"pid": @1,
+                             @"tid": @(record.threadID) }];
+    }
+    return [NSJSONSerialization dataWithJSONObject:@{ @"traceEvents": events, @"displayTimeUnit": @"ms" } options:0 error:nil];
+}
+
+- (NSDictionary *)summary {
+    NSArray *names = nil;
+    NSArray *records = [self snapshotRecordsWithNames:&names];
+    
+    NSMutableDictionary *durationsByName = [NSMutableDictionary dictionary];
+    for (NSValue *value in records) {
+        SSTraceRecord record;
+        [value getValue:&record];
+        NSString *name = names[record.nameIndex];
+        NSMutableArray *durations = durationsByName[name];
+        if (!durations) {
+            durations = [NSMutableArray array];
+            durationsByName[name] = durations;
+        }
+        [durations addObject:@(record.endTime - record.startTime)];
+    }
+    
+    NSMutableDictionary *summary = [NSMutableDictionary dictionary];
+    [durationsByName enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSMutableArray *durations, BOOL *stop) {
+        [durations sortUsingSelector:@selector(compare:)];
+        NSUInteger count = durations.count;
+        NSNumber *(^percentile)(double) = ^(double p) {
+            return durations[MIN((NSUInteger)(p * (count - 1) + 0.5), count - 1)];
+        };
+        summary[name] = @{ @"count": @(count),
+                           @"p50": percentile(0.50),
+                           @"p95": percentile(0.95),
+                           @"p99": percentile(0.99) };
+    }];
+    return summary;
+}
+
+- (void)reset {
+    pthread_mutex_lock(&_lock);
+    _recordCount = 0;
+    pthread_mutex_unlock(&_lock);
+}
+
+#pragma mark - Private methods
+
+- (uint32_t)indexForName:(NSString *)name {
+    pthread_mutex_lock(&_lock);
+    NSNumber *index = _nameIndexes[name];
+    if (!index) {
+        index = @(_names.count);
+        [_names addObject:[name copy]];
+        _nameIndexes[name] = index;
+    }
+    pthread_mutex_unlock(&_lock);
+    return (uint32_t)[index unsignedIntegerValue];
+}
+
+- (void)appendRecord:(SSTraceRecord)record {
+    pthread_mutex_lock(&_lock);
+    _records[_recordCount % kTraceCapacity] = record;
+    _recordCount++;
+    pthread_mutex_unlock(&_lock);
+}
+
+- (NSArray *)snapshotRecordsWithNames:(NSArray **)names {
+    pthread_mutex_lock(&_lock);
+    NSUInteger count = MIN(_recordCount, kTraceCapacity);
+    NSUInteger first = _recordCount - count;
+    NSMutableArray *records = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = first; i < _recordCount; i++) {
+        SSTraceRecord record = _records[i % kTraceCapacity];
+        [records addObject:[NSValue valueWithBytes:&record objCType:@encode(SSTraceRecord)]];
+    }
+    *names = [_names copy];
+    pthread_mutex_unlock(&_lock);
+    return records;
+}
+
+- (void)applicationDidEnterBackground:(NSNotification *)notification {
+    if (!self.enabled) {
+        return;
+    }
+    // Leave the latest trace where it can be pulled off the device for inspection
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+        NSString *cachesPath = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) firstObject];
+        NSString *path = [cachesPath stringByAppendingPathComponent:@"CaptureTrace.json"];
+        [[self chromeTraceData] writeToFile:path atomically:YES];
+        DDLogVerbose(@"Wrote trace to %@; summary: %@", path, [self summary]);
+    });
+}
+
+@end
@@ -37,6 +37,8 @@
 @property (nonatomic, strong) SSStatsService *statsService;
 
 - (IBAction)capture:(id)sender;
+- (IBAction)captureButtonTouchDown:(id)sender;
+- (IBAction)captureButtonTouchCancel:(id)sender;
 - (IBAction)showGeneralSettings:(id)sender;
 - (IBAction)showFlashSettings:(id)sender;
 - (IBAction)showLibrary:(id)sender;
@@ -10,11 +10,15 @@
 #import "SSCameraPreviewView.h"
 #import "SSCameraLockView.h"
 #import "SSCaptureSessionManager.h"
+#import "SSCapturedImage.h"
+#import "SSFlashColorCalibration.h"
 #import "SSLibraryViewController.h"
 #import "SSSettingsService.h"
 #import "SSStatsService.h"
+#import "SSTraceService.h"
 #import <AssetsLibrary/AssetsLibrary.h>
 #import <MediaPlayer/MediaPlayer.h>
+#import <ImageIO/ImageIO.h>
 
 static void * SessionRunningAndDeviceAuthorizedContext = &SessionRunningAndDeviceAuthorizedContext;
 static void * NovaFlashServiceStatus = &NovaFlashServiceStatus;
@@ -27,9 +31,16 @@ static const CFTimeInterval kMinimumTimeBeforeVolumeButtonCapture = 0.1;
 static const CGFloat kZoomMaxScale = 2.5;
 static const CFTimeInterval kZoomSliderHideDelay = 3.0;
 static const NSTimeInterval kZoomSliderAnimationDuration = 0.25;
+// Number of triggers that may be queued behind the capture in progress while shooting continuously
+static const NSUInteger kMaxQueuedCaptures = 2;
+// Number of photos that may be waiting to be written to the asset library before capturing pauses
+static const NSUInteger kMaxPendingSaves = 3;
+// A flash pre-armed this long before a capture begins may already be lighting the preview
+static const CFTimeInterval kPrearmLightingWindow = 1.0;
 
 @interface SSCameraViewController () {
     NSURL *_showPhotoURL;
+    UIImage *_showPhotoPreviewImage;
     BOOL _editPhoto;
     BOOL _sharePhoto;
     CFTimeInterval _audioSessionTimestamp; // Ugly workaround for premature volume notification
@@ -54,7 +65,12 @@ static const NSTimeInterval kZoomSliderAnimationDuration = 0.25;
     SSCameraLockView *_focusLockIndicator;
     SSCameraLockView *_exposureLockIndicator;
 
+    // Capture pipeline. The capture stage (flash, settle, capture) runs one shot at a time;
+    // when shooting continuously, saves to the asset library overlap the next shot.
     BOOL _capturingPhoto;
+    NSUInteger _queuedCaptureCount;
+    NSUInteger _pendingSaveCount;
+    CFTimeInterval _prearmTimestamp;
 }
 @property (nonatomic, strong) SSCaptureSessionManager *captureSessionManager;
 @property (nonatomic, strong) AVAudioPlayer *captureButtonAudioPlayer;
@@ -71,6 +87,10 @@ static const NSTimeInterval kZoomSliderAnimationDuration = 0.25;
 - (void)zoomCheckActivityAndClose;
 - (void)saveAndResetZoom;
 - (void)restoreOrResetZoom;
+- (BOOL)shouldShowPhotoAfterCapture;
+- (void)beginCapture;
+- (void)finishCaptureStage;
+- (void)startQueuedCapture;
 @end
 
 @implementation SSCameraViewController
@@ -127,6 +147,10 @@ static const NSTimeInterval kZoomSliderAnimationDuration = 0.25;
     // Add stats service
     self.statsService = [SSStatsService sharedService];
     
+    // Pre-arm the flash as soon as the capture button is pressed, so it's lit by the time it's released
+    [self.captureButton addTarget:self action:@selector(captureButtonTouchDown:) forControlEvents:UIControlEventTouchDown];
+    [self.captureButton addTarget:self action:@selector(captureButtonTouchCancel:) forControlEvents:UIControlEventTouchUpOutside | UIControlEventTouchCancel];
+    
     // Add tap gesture recognizer for focus/expose
     UITapGestureRecognizer *singleTapGesture = [[UITapGestureRecognizer alloc] initWithTarget:self action:@selector(handleSingleTapFrom:)];
     singleTapGesture.numberOfTapsRequired = 1;
@@ -261,11 +285,13 @@ static const NSTimeInterval kZoomSliderAnimationDuration = 0.25;
         SSLibraryViewController *vc = (SSLibraryViewController *)segue.destinationViewController;
         if (_showPhotoURL) {
             vc.prepareToDisplayAssetURL = _showPhotoURL;
+            vc.prepareToDisplayPreviewImage = _showPhotoPreviewImage;
             vc.automaticallyEditPhoto = _editPhoto;
             vc.automaticallySharePhoto = _sharePhoto;
             _editPhoto = NO;
             _sharePhoto = NO;
             _showPhotoURL = nil;
+            _showPhotoPreviewImage = nil;
         } else {
             DDLogVerbose(@"showPhoto with no photo URL");
         }
@@ -325,53 +351,29 @@ static const NSTimeInterval kZoomSliderAnimationDuration = 0.25;
 #pragma mark - Public methods
 
 - (IBAction)capture:(id)sender {
-    if (_capturingPhoto) {
+    if (_capturingPhoto || _pendingSaveCount >= kMaxPendingSaves) {
+        if (![self shouldShowPhotoAfterCapture] && _queuedCaptureCount < kMaxQueuedCaptures) {
+            DDLogVerbose(@"Capture pipeline busy; queueing trigger");
+            _queuedCaptureCount++;
+            return;
+        }
         DDLogVerbose(@"Still capturing previous image. Ignore trigger.");
         [self.statsService report:@"Photo Failed (already capturing)"
                        properties:@{}];
         return;
     }
-    _capturingPhoto = YES;
-    DDLogVerbose(@"Capture!");
-    [self.statsService report:@"Take Photo"
-                   properties:@{ @"Flash Mode": SSFlashSettingsDescribe(self.flashService.flashSettings) }];
-    [self.flashService beginFlashWithCallback:^(BOOL status) {
-        [self.statsService report: status ? @"Flash Succeeded" : @"Flash Failed"];
-        DDLogVerbose(@"Nova flash begin returned with status %d; performing capture", status);
-        [self.captureSessionManager captureStillImageWithCompletionHandler:^(NSData *imageData, UIImage *image, NSError *error) {
-            
-            DDLogVerbose(@"Finished capture; turning off flash");
-            [self.flashService endFlashWithCallback:nil];
-            
-            if (error) {
-                DDLogError(@"Error capturing: %@", error);
-                _capturingPhoto = NO;
-            } else {
-                DDLogVerbose(@"Saving to asset library");
-                __block typeof(self) bSelf = self;
-                [[[ALAssetsLibrary alloc] init] writeImageToSavedPhotosAlbum:[image CGImage]
-                                                                 orientation:(ALAssetOrientation)[image imageOrientation]
-                                                             completionBlock:^(NSURL *assetURL, NSError *error) {
+    [self beginCapture];
+}
 
-                    _capturingPhoto = NO;
-                    _editPhoto = [self.settingsService boolForKey:kSettingsServiceEditAfterCaptureKey];
-                    _sharePhoto = [self.settingsService boolForKey:kSettingsServiceShareAfterCaptureKey];
+- (IBAction)captureButtonTouchDown:(id)sender {
+    if (!_capturingPhoto) {
+        _prearmTimestamp = CACurrentMediaTime();
+        [self.flashService prearmFlash];
+    }
+}
 
-                    if (_editPhoto || _sharePhoto || [self.settingsService boolForKey:kSettingsServicePreviewAfterCaptureKey]) {
-                        _showPhotoURL = assetURL;
-                        [bSelf performSegueWithIdentifier:@"showPhoto" sender:self];
-                    } else {
-                        DDLogVerbose(@"Continuous shooting; skipping view screen");
-                    }
-                }];
-            }
-        } shutterHandler:^(int shutterCurtain) {
-            DDLogVerbose(@"Shutter curtain %d", shutterCurtain);
-            if (shutterCurtain == 1) {
-                [self runStillImageCaptureAnimation];
-            }
-        }];
-    }];
+- (IBAction)captureButtonTouchCancel:(id)sender {
+    [self.flashService cancelPrearm];
 }
 
 - (IBAction)showGeneralSettings:(id)sender {
@@ -614,6 +616,161 @@ static const NSTimeInterval kZoomSliderAnimationDuration = 0.25;
     [self.view addSubview:self.volumeView];
 }
 
+- (BOOL)shouldShowPhotoAfterCapture {
+    return ([self.settingsService boolForKey:kSettingsServiceEditAfterCaptureKey] ||
+            [self.settingsService boolForKey:kSettingsServiceShareAfterCaptureKey] ||
+            [self.settingsService boolForKey:kSettingsServicePreviewAfterCaptureKey]);
+}
+
+- (void)beginCapture {
+    _capturingPhoto = YES;
+    CFTimeInterval triggerTime = CACurrentMediaTime();
+    BOOL showPhotoAfterCapture = [self shouldShowPhotoAfterCapture];
+    DDLogVerbose(@"Capture!");
+    SSFlashSettings flashSettings = self.flashService.flashSettings;
+    [self.statsService report:@"Take Photo"
+                   properties:@{ @"Flash Mode": SSFlashSettingsDescribe(flashSettings) }];
+    // Hold on to a frame of the unlit scene now, before the buffer fills with flash-lit ones
+    id ambientFrame = nil;
+    if (flashSettings.flashMode != SSFlashModeOff) {
+        BOOL prearmed = (triggerTime - _prearmTimestamp < kPrearmLightingWindow);
+        ambientFrame = [self.captureSessionManager ambientFrameBeforeTime:(prearmed ? _prearmTimestamp : triggerTime)];
+    }
+    [self.flashService beginFlashWithCallback:^(BOOL status) {
+        CFTimeInterval flashTime = CACurrentMediaTime();
+        [self.statsService report: status ? @"Flash Succeeded" : @"Flash Failed"];
+        DDLogVerbose(@"Nova flash begin returned with status %d; performing capture", status);
+        BOOL flashLit = (status && flashSettings.flashMode != SSFlashModeOff);
+        // What the flash actually fired with, which auto brightness may have scaled down
+        SSFlashSettings firedFlashSettings = self.flashService.firedFlashSettings;
+        // A fused image already has the colour of the ambient light
+        BOOL correctColor = (flashLit && !ambientFrame && [self.settingsService boolForKey:kSettingsServiceFlashColorCorrectionKey]);
+        void (^storeCapturedImage)(SSCapturedImage *, CFTimeInterval) = ^(SSCapturedImage *capturedImage, CFTimeInterval captureTime) {
+            // Build the review screen's preview while the photo is being saved
+            __block UIImage *previewImage = nil;
+            dispatch_group_t previewGroup = dispatch_group_create();
+            if (showPhotoAfterCapture) {
+                CGSize screenSize = [UIScreen mainScreen].bounds.size;
+                CGFloat maxPixelSize = MAX(screenSize.width, screenSize.height) * [UIScreen mainScreen].scale;
+                dispatch_group_async(previewGroup, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+                    SSTraceSpan previewSpan = [[SSTraceService sharedService] beginSpan:@"capture.preview"];
+                    previewImage = [capturedImage previewImageWithMaxPixelSize:maxPixelSize];
+                    [[SSTraceService sharedService] endSpan:previewSpan];
+                });
+            }
+            
+            // Record the flash settings in the photo, so the library can tell Nova shots apart
+            // The library merges only top-level dictionaries, so extend the still's own EXIF
+            // rather than replacing its date, exposure and ISO with just the comment
+            NSDictionary *flashMetadata = nil;
+            if (flashLit) {
+                NSMutableDictionary *exif = [NSMutableDictionary dictionaryWithDictionary:capturedImage.metadata[(__bridge NSString *)kCGImagePropertyExifDictionary]];
+                exif[(__bridge NSString *)kCGImagePropertyExifUserComment] = SSFlashSettingsUserComment(firedFlashSettings);
+                flashMetadata = @{ (__bridge NSString *)kCGImagePropertyExifDictionary: exif };
+            }
+            
+            DDLogVerbose(@"Saving to asset library");
+            __block typeof(self) bSelf = self;
+            [capturedImage writeToSavedPhotosAlbumWithLibrary:[[ALAssetsLibrary alloc] init]
+                                                     metadata:flashMetadata
+                                              completionBlock:^(NSURL *assetURL, NSError *error) {
+                CFTimeInterval saveTime = CACurrentMediaTime();
+                _pendingSaveCount--;
+                DDLogVerbose(@"Shot stage latencies: flash %.0f ms, capture %.0f ms, save %.0f ms (%lu saves pending)",
+                             (flashTime - triggerTime) * 1000.0,
+                             (captureTime - flashTime) * 1000.0,
+                             (saveTime - captureTime) * 1000.0,
+                             (unsigned long)_pendingSaveCount);
+                SSTraceService *traceService = [SSTraceService sharedService];
+                [traceService recordSpan:@"capture.flash" startTime:triggerTime endTime:flashTime];
+                [traceService recordSpan:@"capture.still" startTime:flashTime endTime:captureTime];
+                [traceService recordSpan:@"capture.save" startTime:captureTime endTime:saveTime];
+                [traceService recordSpan:@"capture.total" startTime:triggerTime endTime:saveTime];
+                
+                if (showPhotoAfterCapture) {
+                    dispatch_group_notify(previewGroup, dispatch_get_main_queue(), ^{
+                        _editPhoto = [bSelf.settingsService boolForKey:kSettingsServiceEditAfterCaptureKey];
+                        _sharePhoto = [bSelf.settingsService boolForKey:kSettingsServiceShareAfterCaptureKey];
+                        _showPhotoURL = assetURL;
+                        _showPhotoPreviewImage = previewImage;
+                        _queuedCaptureCount = 0;
+                        SSTraceSpan segueSpan = [[SSTraceService sharedService] beginSpan:@"capture.segue"];
+                        [bSelf performSegueWithIdentifier:@"showPhoto" sender:bSelf];
+                        [[SSTraceService sharedService] endSpan:segueSpan];
+                    });
+                } else {
+                    DDLogVerbose(@"Continuous shooting; skipping view screen");
+                    // A save slot has freed up
+                    [bSelf startQueuedCapture];
+                }
+            }];
+        };
+        void (^captureCompletion)(SSCapturedImage *, NSError *) = ^(SSCapturedImage *capturedImage, NSError *error) {
+            CFTimeInterval captureTime = CACurrentMediaTime();
+            BOOL captured = (!error && capturedImage);
+            
+            if (captured) {
+                // Count the shot against the save limit as soon as it exists, so no more shots
+                // are started while it's still being corrected or fused
+                _pendingSaveCount++;
+                if (showPhotoAfterCapture) {
+                    // This shot goes to the review screen; don't start any others meanwhile
+                    _queuedCaptureCount = 0;
+                }
+            }
+            
+            DDLogVerbose(@"Finished capture; turning off flash");
+            [self.flashService endFlashWithCallback:^(BOOL status) {
+                // The next shot can't begin its flash until the units are out. Its flash and
+                // settle then overlap this shot's correction and save.
+                [self finishCaptureStage];
+            }];
+            
+            if (!captured) {
+                DDLogError(@"Error capturing: %@", error);
+                return;
+            }
+            
+            if (flashLit && ambientFrame) {
+                [self.captureSessionManager fuseCapturedImage:capturedImage withAmbientFrame:ambientFrame completionHandler:^(SSCapturedImage *fusedImage) {
+                    storeCapturedImage(fusedImage, captureTime);
+                }];
+            } else if (correctColor) {
+                [[SSFlashColorCalibration sharedService] correctCapturedImage:capturedImage forFlashSettings:firedFlashSettings completion:^(SSCapturedImage *correctedImage) {
+                    storeCapturedImage(correctedImage ?: capturedImage, captureTime);
+                }];
+            } else {
+                storeCapturedImage(capturedImage, captureTime);
+            }
+        };
+        void (^shutterHandler)(int) = ^(int shutterCurtain) {
+            DDLogVerbose(@"Shutter curtain %d", shutterCurtain);
+            if (shutterCurtain == 1) {
+                [self runStillImageCaptureAnimation];
+            }
+        };
+        if (flashLit) {
+            [self.captureSessionManager captureFlashStillImageWithCompletionHandler:captureCompletion shutterHandler:shutterHandler];
+        } else {
+            // Buffered preview frames are unlit, so they're only usable when the flash isn't
+            // firing; then the moment the shutter was pressed may still be among them
+            [self.captureSessionManager captureImageNearTime:triggerTime completionHandler:captureCompletion shutterHandler:shutterHandler];
+        }
+    }];
+}
+
+- (void)finishCaptureStage {
+    _capturingPhoto = NO;
+    [self startQueuedCapture];
+}
+
+- (void)startQueuedCapture {
+    if (_queuedCaptureCount > 0 && !_capturingPhoto && _pendingSaveCount < kMaxPendingSaves) {
+        _queuedCaptureCount--;
+        [self beginCapture];
+    }
+}
+
 - (void)volumeChanged:(NSNotification *)notification {
     bool enabled = [[SSSettingsService sharedService] boolForKey:kSettingsServiceEnableVolumeButtonTriggerKey];
 
@@ -29,6 +29,11 @@
  */
 @property (nonatomic, strong) NSURL *prepareToDisplayAssetURL;
 
+/**
+ * Optional preview of `prepareToDisplayAssetURL`, shown while its full screen image loads
+ */
+@property (nonatomic, strong) UIImage *prepareToDisplayPreviewImage;
+
 /**
  * Flag to determine whetehr this photo should be automatically edited
  */
@@ -8,8 +8,10 @@
 
 #import "SSLibraryViewController.h"
 #import "SSChronologicalAssetsLibraryService.h"
+#import "SSImageJobScheduler.h"
 #import "SSPhotoViewController.h"
 #import "SSStatsService.h"
+#import "UIImage+JPEGFile.h"
 #import <AviarySDK/AviarySDK.h>
 #import <MBProgressHUD/MBProgressHUD.h>
 
@@ -57,6 +59,11 @@ static const NSTimeInterval kOrientationChangeAnimationDuration = 0.25;
  */
 - (SSPhotoViewController *)photoViewControllerForAssetURL:(NSURL *)assetURL markAsActive:(BOOL)isActive;
 
+/**
+ * Show specified asset, displaying `placeholderImage` until its full screen image has loaded
+ */
+- (void)showAssetWithURL:(NSURL *)assetURL placeholderImage:(UIImage *)placeholderImage animated:(BOOL)animated;
+
 /**
  * Helper to launch the photo editor for specified asset
  */
@@ -181,8 +188,9 @@ static const NSTimeInterval kOrientationChangeAnimationDuration = 0.25;
     [super viewDidAppear:animated];
     
     if (self.prepareToDisplayAssetURL) {
-        [self showAssetWithURL:self.prepareToDisplayAssetURL animated:NO];
+        [self showAssetWithURL:self.prepareToDisplayAssetURL placeholderImage:self.prepareToDisplayPreviewImage animated:NO];
         self.prepareToDisplayAssetURL = nil;
+        self.prepareToDisplayPreviewImage = nil;
     }
     
     if (self.automaticallyEditPhoto) {
@@ -310,8 +318,13 @@ static const NSTimeInterval kOrientationChangeAnimationDuration = 0.25;
 }
 
 - (void)showAssetWithURL:(NSURL *)assetURL animated:(BOOL)animated {
+    [self showAssetWithURL:assetURL placeholderImage:nil animated:animated];
+}
+
+- (void)showAssetWithURL:(NSURL *)assetURL placeholderImage:(UIImage *)placeholderImage animated:(BOOL)animated {
     _lastAssetURL = assetURL;
     SSPhotoViewController *photoVC = [self photoViewControllerForAssetURL:assetURL markAsActive:YES];
+    photoVC.placeholderImage = placeholderImage;
     NSUInteger idx = [self.libraryService indexOfAssetWithURL:assetURL];
     DDLogVerbose(@"showAssetWithURL:%@ asset idx: %d", assetURL, (int)idx);
     UIPageViewControllerNavigationDirection dir = UIPageViewControllerNavigationDirectionForward;
@@ -334,6 +347,16 @@ static const NSTimeInterval kOrientationChangeAnimationDuration = 0.25;
 
 #pragma mark - Properties
 
+- (void)setSelectedIndex:(NSUInteger)selectedIndex {
+    [self willChangeValueForKey:@"selectedIndex"];
+    _selectedIndex = selectedIndex;
+    [self didChangeValueForKey:@"selectedIndex"];
+    
+    if (selectedIndex != NSNotFound) {
+        [self.libraryService prefetchFullScreenImagesAroundIndex:selectedIndex];
+    }
+}
+
 - (SSChronologicalAssetsLibraryService *)libraryService {
     if (!_libraryService) {
         _libraryService = [SSChronologicalAssetsLibraryService sharedService];
@@ -419,14 +442,37 @@ static const NSTimeInterval kOrientationChangeAnimationDuration = 0.25;
     // Save image to asset library, in background
     DDLogVerbose(@"Encoding & saving modified image to asset library, in background");
     __block typeof(self) bSelf = self;
-    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
-        NSData *imageData = UIImageJPEGRepresentation(image, 0.9);
+    // The user is waiting on the HUD; the encoder holds roughly one more bitmap while it works
+    NSUInteger cost = (NSUInteger)(image.size.width * image.scale * image.size.height * image.scale) * 4;
+    [[SSImageJobScheduler sharedService] scheduleJobWithPriority:SSImageJobPriorityVisible cost:cost block:^(SSImageJob *job) {
+        // Encode to a temporary file rather than into memory, then hand the asset library a
+        // memory-mapped view of it; a 12 MP edit otherwise needs a second huge buffer at peak.
+        NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+        NSError *encodeError = nil;
+        NSData *imageData = nil;
+        if ([image writeJPEGToFile:path compressionQuality:0.9 error:&encodeError]) {
+            imageData = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:&encodeError];
+        }
+        if (!imageData) {
+            DDLogError(@"Error encoding modified image: %@", encodeError);
+            imageData = UIImageJPEGRepresentation(image, 0.9);
+        }
         NSDictionary *metadata = @{};
         
         // Retrieve current asset to write modified image data to
         [self.libraryService assetForURL:_lastAssetURL withCompletion:^(ALAsset *asset) {
+            if (!asset) {
+                // Nothing will be written, so clean up here
+                DDLogError(@"Unable to find asset %@ to save modified image to", _lastAssetURL);
+                [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    [MBProgressHUD hideAllHUDsForView:self.view animated:YES];
+                });
+                return;
+            }
             [asset writeModifiedImageDataToSavedPhotosAlbum:imageData metadata:metadata completionBlock:^(NSURL *assetURL, NSError *error) {
                 DDLogVerbose(@"Modified image saved to asset library: %@ (Error: %@)", assetURL, error);
+                [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
                 dispatch_async(dispatch_get_main_queue(), ^{
 
                     // Remove HUD
@@ -445,7 +491,7 @@ static const NSTimeInterval kOrientationChangeAnimationDuration = 0.25;
                 });
             }];
         }];
-    });
+    }];
 }
 
 - (void)assetLibraryUpdatedWithNotification:(NSNotification *)notification {
@@ -540,10 +586,15 @@ static const NSTimeInterval kOrientationChangeAnimationDuration = 0.25;
 
 - (void)pageViewController:(UIPageViewController *)pageViewController didFinishAnimating:(BOOL)finished previousViewControllers:(NSArray *)previousViewControllers transitionCompleted:(BOOL)completed {
     // Update selected index
+    SSPhotoViewController *vc = [pageViewController.viewControllers firstObject];
+    NSURL *assetURL = vc.assetURL;
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
-        SSPhotoViewController *vc = [pageViewController.viewControllers firstObject];
-        self.selectedIndex = [self.libraryService indexOfAssetWithURL:vc.assetURL];
-        _lastAssetURL = vc.assetURL;
+        NSUInteger index = [self.libraryService indexOfAssetWithURL:assetURL];
+        // Setting the index prefetches around it, which must see the asset list as the main thread does
+        dispatch_async(dispatch_get_main_queue(), ^{
+            self.selectedIndex = index;
+            _lastAssetURL = assetURL;
+        });
     });
 }
 
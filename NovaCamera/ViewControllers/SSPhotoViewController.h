@@ -30,6 +30,12 @@
  */
 @property (nonatomic, strong) NSURL *assetURL;
 
+/**
+ * Image to display until the full screen image for `assetURL` has loaded, e.g. a preview
+ * of a photo that was just captured
+ */
+@property (nonatomic, strong) UIImage *placeholderImage;
+
 /**
  * Image view containing the target image
  */
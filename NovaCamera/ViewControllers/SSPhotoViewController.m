@@ -48,6 +48,9 @@
 - (void)viewWillAppear:(BOOL)animated {
     [super viewWillAppear:animated];
     if (self.assetURL && !self.imageView.image) {
+        if (self.placeholderImage) {
+            [self displayImage:self.placeholderImage];
+        }
         [self displayAssetWithURL:self.assetURL];
     }
 }
@@ -67,6 +70,16 @@
     [self didChangeValueForKey:@"assetURL"];
 }
 
+- (void)setPlaceholderImage:(UIImage *)placeholderImage {
+    [self willChangeValueForKey:@"placeholderImage"];
+    _placeholderImage = placeholderImage;
+    [self didChangeValueForKey:@"placeholderImage"];
+    
+    if (placeholderImage && self.isViewLoaded && !self.imageView.image) {
+        [self displayImage:placeholderImage];
+    }
+}
+
 #pragma mark - Private methods
 
 - (void)displayImage:(UIImage *)image {